@@ -0,0 +1,37 @@
+# Run a script on the software renderer and compare its last frame with a reference image, byte for byte
+# NOTE script errors are only reported by the engine, so the test also fails if any are printed
+# Usage: cmake -DENGINE=<engine> -DSCRIPT=<script> -DOUTPUT=<image> -DREFERENCE=<image> [-DUPDATE=TRUE] -P CompareFrame.cmake
+# NOTE with UPDATE set, the reference image is replaced by the output instead
+
+get_filename_component(OUTPUT_DIR ${OUTPUT} DIRECTORY)
+file(MAKE_DIRECTORY ${OUTPUT_DIR})
+file(REMOVE ${OUTPUT})
+
+# Fixed settings, so every run draws the same frame
+set(ENV{SOFT_FRAMES} 120)
+set(ENV{SOFT_WIDTH} 160)
+set(ENV{SOFT_HEIGHT} 120)
+set(ENV{SOFT_THREADS} 1)
+set(ENV{SOFT_OUTPUT} ${OUTPUT})
+execute_process(COMMAND ${ENGINE} -soft ${SCRIPT} RESULT_VARIABLE RESULT ERROR_VARIABLE ERRORS)
+if(NOT RESULT EQUAL 0 OR NOT EXISTS ${OUTPUT})
+    message(FATAL_ERROR "${SCRIPT} did not write a frame\n${ERRORS}")
+endif()
+if(ERRORS MATCHES "\\.lua:[0-9]+:")
+    message(FATAL_ERROR "${SCRIPT} reported errors\n${ERRORS}")
+endif()
+
+if(UPDATE)
+    configure_file(${OUTPUT} ${REFERENCE} COPYONLY)
+    message(STATUS "Updated ${REFERENCE}")
+    return()
+endif()
+
+if(NOT EXISTS ${REFERENCE})
+    message(FATAL_ERROR "Missing reference image ${REFERENCE}; configure with UPDATE_REFERENCE_FRAMES to create it")
+endif()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${OUTPUT} ${REFERENCE} RESULT_VARIABLE DIFFERENT)
+if(DIFFERENT)
+    message(FATAL_ERROR "${OUTPUT} differs from ${REFERENCE}")
+endif()
@@ -58,3 +58,28 @@ bool Aabb::getCollisionTime(const Aabb& other, float velX, float velY, float& st
     end = std::min(endX, endY);
     return start < end;
 }
+
+void Aabb::getNormal(Edge edge, float& normX, float& normY)
+{
+    switch (edge)
+    {
+    case Left:
+        normX = -1.f;
+        normY = 0.f;
+        break;
+    case Right:
+        normX = 1.f;
+        normY = 0.f;
+        break;
+    case Bottom:
+        normX = 0.f;
+        normY = -1.f;
+        break;
+    case Top:
+        normX = 0.f;
+        normY = 1.f;
+        break;
+    default:
+        break;
+    }
+}
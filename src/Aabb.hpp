@@ -5,6 +5,7 @@ class Aabb
     struct {float l, t, r, b;} m_bounds;
 
 public:
+    Aabb(): m_bounds{0.f, 0.f, 0.f, 0.f} {}
     Aabb(float l, float t, float r, float b): m_bounds{l, t, r, b} {}
 
     bool isContaining(float x, float y) const
@@ -12,6 +13,13 @@ public:
         return m_bounds.r > x && m_bounds.l <= x && m_bounds.b > y && m_bounds.t <= y;
     }
 
+    // NOTE inclusive of all edges
+    bool isContaining(const Aabb& other) const
+    {
+        return m_bounds.l <= other.m_bounds.l && m_bounds.r >= other.m_bounds.r
+            && m_bounds.t <= other.m_bounds.t && m_bounds.b >= other.m_bounds.b;
+    }
+
     bool isOverlapping(const Aabb& other) const
     {
         return m_bounds.r > other.m_bounds.l && m_bounds.l < other.m_bounds.r
@@ -21,6 +29,7 @@ public:
     // NOTE here we assume that we are static and the other AABB is moving
     enum Edge {None, Left, Right, Bottom, Top};
     bool getCollisionTime(const Aabb& other, float velX, float velY, float& start, float& end, Edge& edge) const;
+    static void getNormal(Edge edge, float& normX, float& normY);
 
     float getLeft() const {return m_bounds.l;}
     float getBottom() const {return m_bounds.b;}
@@ -30,5 +39,24 @@ public:
     float getWidth() const {return m_bounds.r - m_bounds.l;}
     float getHeight() const {return m_bounds.b - m_bounds.t;}
 
+    float getPerimeter() const {return 2.f * (getWidth() + getHeight());}
+
+    // Grow to cover another AABB, or by a margin on all sides
+    void addBounds(const Aabb& other)
+    {
+        m_bounds.l = other.m_bounds.l < m_bounds.l ? other.m_bounds.l : m_bounds.l;
+        m_bounds.t = other.m_bounds.t < m_bounds.t ? other.m_bounds.t : m_bounds.t;
+        m_bounds.r = other.m_bounds.r > m_bounds.r ? other.m_bounds.r : m_bounds.r;
+        m_bounds.b = other.m_bounds.b > m_bounds.b ? other.m_bounds.b : m_bounds.b;
+    }
+    void addMargin(float margin) {m_bounds.l -= margin; m_bounds.t -= margin; m_bounds.r += margin; m_bounds.b += margin;}
+
     void addOffset(float x, float y) {m_bounds.l += x; m_bounds.r += x; m_bounds.b += y; m_bounds.t += y;}
+
+    // Grow to cover the AABB moving by offset x, y
+    void addSweep(float x, float y)
+    {
+        (x < 0.f ? m_bounds.l : m_bounds.r) += x;
+        (y < 0.f ? m_bounds.t : m_bounds.b) += y;
+    }
 };
@@ -40,7 +40,7 @@ bool AabbCollider::testCollision(float deltaX, float deltaY, const ICollider* ot
 }
 
 // NOTE here we are taking the velocity of the other object
-bool AabbCollider::getCollisionTime(const Aabb& aabb, float velX, float velY, float& start, float& end, float& normX, float& normY) const
+bool AabbCollider::getCollisionTime(const Aabb& aabb, float velX, float velY, float /*horizon*/, float& start, float& end, float& normX, float& normY) const
 {
     assert(m_actor != nullptr);
 
@@ -51,33 +51,13 @@ bool AabbCollider::getCollisionTime(const Aabb& aabb, float velX, float velY, fl
 
     Aabb::Edge edge;
     bool result = self.getCollisionTime(aabb, velX, velY, start, end, edge);
-    switch (edge)
-    {
-    case Aabb::Left:
-        normX = -1.f;
-        normY = 0.f;
-        break;
-    case Aabb::Right:
-        normX = 1.f;
-        normY = 0.f;
-        break;
-    case Aabb::Bottom:
-        normX = 0.f;
-        normY = -1.f;
-        break;
-    case Aabb::Top:
-        normX = 0.f;
-        normY = 1.f;
-        break;
-    default:
-        break;
-    }
+    Aabb::getNormal(edge, normX, normY);
     return result;
 }
 
 // NOTE here we are taking the velocity of THIS object
 // TODO maybe we should just pull these velocities from the actor physics component???
-bool AabbCollider::getCollisionTime(float velX, float velY, const ICollider* other, float& start, float& end, float& normX, float& normY) const
+bool AabbCollider::getCollisionTime(float velX, float velY, const ICollider* other, float horizon, float& start, float& end, float& normX, float& normY) const
 {
     assert(m_actor != nullptr);
     assert(other != nullptr);
@@ -86,6 +66,6 @@ bool AabbCollider::getCollisionTime(float velX, float velY, const ICollider* oth
         return false;
 
     const Aabb bounds = m_actor->getAabb();
-    bool result = other->getCollisionTime(bounds, velX, velY, start, end, normX, normY);
+    bool result = other->getCollisionTime(bounds, velX, velY, horizon, start, end, normX, normY);
     return result;
 }
@@ -16,8 +16,8 @@ public:
     bool testCollision(const Aabb& aabb) const override;
     bool testCollision(float deltaX, float deltaY, const ICollider* other) const override;
 
-    bool getCollisionTime(const Aabb& aabb, float velX, float velY, float& start, float& end, float& normX, float& normY) const override;
-    bool getCollisionTime(float velX, float velY, const ICollider* other, float& start, float& end, float& normX, float& normY) const override;
+    bool getCollisionTime(const Aabb& aabb, float velX, float velY, float horizon, float& start, float& end, float& normX, float& normY) const override;
+    bool getCollisionTime(float velX, float velY, const ICollider* other, float horizon, float& start, float& end, float& normX, float& normY) const override;
 
 private:
     friend class TUserdata<AabbCollider, ICollider>;
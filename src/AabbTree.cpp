@@ -0,0 +1,381 @@
+#include "AabbTree.hpp"
+#include "Actor.hpp"
+
+#include <algorithm>
+
+constexpr const float AabbTree::Margin;
+
+void AabbTree::insert(Actor* actor)
+{
+    if (actor->m_tree == this)
+        return;
+
+    // Take the Actor from any other Canvas it is still indexed by
+    if (actor->m_tree)
+        actor->m_tree->remove(actor);
+
+    Aabb bounds = actor->getAabb();
+    bounds.addMargin(Margin);
+
+    const int leaf = allocateNode();
+    Node& node = m_nodes[leaf];
+    node.bounds = bounds;
+    node.actor = actor;
+    node.height = 0;
+    insertLeaf(leaf);
+
+    actor->m_tree = this;
+    actor->m_proxy = leaf;
+}
+
+void AabbTree::remove(Actor* actor)
+{
+    assert(actor->m_tree == this);
+    const int leaf = actor->m_proxy;
+
+    removeLeaf(leaf);
+    if (m_nodes[leaf].moved)
+        m_moved.erase(std::find(m_moved.begin(), m_moved.end(), leaf));
+    freeNode(leaf);
+
+    actor->m_tree = nullptr;
+    actor->m_proxy = -1;
+}
+
+void AabbTree::removeAll()
+{
+    for (auto& node : m_nodes)
+    {
+        if (node.height == 0)
+        {
+            node.actor->m_tree = nullptr;
+            node.actor->m_proxy = -1;
+        }
+    }
+
+    m_nodes.clear();
+    m_moved.clear();
+    m_root = -1;
+    m_free = -1;
+}
+
+void AabbTree::markMoved(Actor* actor)
+{
+    assert(actor->m_tree == this);
+    Node& node = m_nodes[actor->m_proxy];
+    if (node.moved)
+        return;
+
+    node.moved = true;
+    m_moved.push_back(actor->m_proxy);
+}
+
+void AabbTree::update()
+{
+    for (int leaf : m_moved)
+    {
+        Node& node = m_nodes[leaf];
+        node.moved = false;
+
+        // Nothing to do while still inside the fat bounds
+        Aabb bounds = node.actor->getAabb();
+        if (node.bounds.isContaining(bounds))
+            continue;
+
+        removeLeaf(leaf);
+        bounds.addMargin(Margin);
+        m_nodes[leaf].bounds = bounds;
+        insertLeaf(leaf);
+    }
+
+    m_moved.clear();
+}
+
+void AabbTree::setOrder(Actor* actor, int order)
+{
+    assert(actor->m_tree == this);
+    m_nodes[actor->m_proxy].order = order;
+}
+
+int AabbTree::getOrder(const Actor* actor) const
+{
+    assert(actor->m_tree == this);
+    return m_nodes[actor->m_proxy].order;
+}
+
+bool AabbTree::isTouching(const Aabb& bounds, float x, float y, float dx, float dy, float maxFraction)
+{
+    // Clip the segment against each pair of edges in turn
+    float start = 0.f, end = maxFraction;
+
+    if (dx != 0.f)
+    {
+        float t1 = (bounds.getLeft() - x) / dx;
+        float t2 = (bounds.getRight() - x) / dx;
+        if (t1 > t2)
+            std::swap(t1, t2);
+        start = std::max(start, t1);
+        end = std::min(end, t2);
+    }
+    else if (x < bounds.getLeft() || x > bounds.getRight())
+    {
+        return false;
+    }
+
+    if (dy != 0.f)
+    {
+        float t1 = (bounds.getTop() - y) / dy;
+        float t2 = (bounds.getBottom() - y) / dy;
+        if (t1 > t2)
+            std::swap(t1, t2);
+        start = std::max(start, t1);
+        end = std::min(end, t2);
+    }
+    else if (y < bounds.getTop() || y > bounds.getBottom())
+    {
+        return false;
+    }
+
+    return start <= end;
+}
+
+int AabbTree::allocateNode()
+{
+    if (m_free < 0)
+    {
+        m_nodes.emplace_back();
+        return int(m_nodes.size()) - 1;
+    }
+
+    const int index = m_free;
+    m_free = m_nodes[index].parent;
+    m_nodes[index] = Node();
+    return index;
+}
+
+void AabbTree::freeNode(int index)
+{
+    Node& node = m_nodes[index];
+    node.actor = nullptr;
+    node.height = -1;
+    node.moved = false;
+    node.parent = m_free;
+    m_free = index;
+}
+
+void AabbTree::insertLeaf(int leaf)
+{
+    if (m_root < 0)
+    {
+        m_root = leaf;
+        m_nodes[leaf].parent = -1;
+        return;
+    }
+
+    // Find the best sibling by walking down, choosing the child that grows least
+    const Aabb bounds = m_nodes[leaf].bounds;
+    int index = m_root;
+    while (!m_nodes[index].isLeaf())
+    {
+        const Node& node = m_nodes[index];
+
+        Aabb combined = node.bounds;
+        combined.addBounds(bounds);
+        const float area = node.bounds.getPerimeter();
+        const float combinedArea = combined.getPerimeter();
+
+        // Cost of making a new parent for this node and the leaf, and the cost pushed down to the children
+        const float cost = 2.f * combinedArea;
+        const float inheritance = 2.f * (combinedArea - area);
+
+        auto getCost = [&](int child)
+        {
+            Aabb childCombined = m_nodes[child].bounds;
+            childCombined.addBounds(bounds);
+            const float growth = childCombined.getPerimeter();
+            return (m_nodes[child].isLeaf() ? growth : growth - m_nodes[child].bounds.getPerimeter()) + inheritance;
+        };
+
+        const float cost1 = getCost(node.child1);
+        const float cost2 = getCost(node.child2);
+        if (cost < cost1 && cost < cost2)
+            break;
+
+        index = cost1 < cost2 ? node.child1 : node.child2;
+    }
+
+    // Make a new parent for the sibling and the leaf
+    const int sibling = index;
+    const int oldParent = m_nodes[sibling].parent;
+    const int newParent = allocateNode();
+    {
+        Node& node = m_nodes[newParent];
+        node.parent = oldParent;
+        node.bounds = bounds;
+        node.bounds.addBounds(m_nodes[sibling].bounds);
+        node.height = m_nodes[sibling].height + 1;
+        node.child1 = sibling;
+        node.child2 = leaf;
+    }
+
+    if (oldParent >= 0)
+    {
+        Node& parent = m_nodes[oldParent];
+        (parent.child1 == sibling ? parent.child1 : parent.child2) = newParent;
+    }
+    else
+    {
+        m_root = newParent;
+    }
+    m_nodes[sibling].parent = newParent;
+    m_nodes[leaf].parent = newParent;
+
+    refit(newParent);
+}
+
+void AabbTree::removeLeaf(int leaf)
+{
+    if (leaf == m_root)
+    {
+        m_root = -1;
+        return;
+    }
+
+    const int parent = m_nodes[leaf].parent;
+    const int grandParent = m_nodes[parent].parent;
+    const int sibling = m_nodes[parent].child1 == leaf ? m_nodes[parent].child2 : m_nodes[parent].child1;
+
+    if (grandParent < 0)
+    {
+        m_root = sibling;
+        m_nodes[sibling].parent = -1;
+        freeNode(parent);
+        return;
+    }
+
+    // Replace the parent with the sibling, then refit above
+    Node& grand = m_nodes[grandParent];
+    (grand.child1 == parent ? grand.child1 : grand.child2) = sibling;
+    m_nodes[sibling].parent = grandParent;
+    freeNode(parent);
+
+    refit(grandParent);
+}
+
+void AabbTree::refit(int index)
+{
+    // Walk back up to the root, rebalancing and growing bounds to fit the children
+    for (; index >= 0; index = m_nodes[index].parent)
+    {
+        index = balance(index);
+
+        Node& node = m_nodes[index];
+        const Node& child1 = m_nodes[node.child1];
+        const Node& child2 = m_nodes[node.child2];
+        node.height = 1 + std::max(child1.height, child2.height);
+        node.bounds = child1.bounds;
+        node.bounds.addBounds(child2.bounds);
+    }
+}
+
+int AabbTree::balance(int indexA)
+{
+    // Rotate the taller child up when heights differ by more than one
+    Node& a = m_nodes[indexA];
+    if (a.isLeaf() || a.height < 2)
+        return indexA;
+
+    const int indexB = a.child1;
+    const int indexC = a.child2;
+    Node& b = m_nodes[indexB];
+    Node& c = m_nodes[indexC];
+    const int difference = c.height - b.height;
+
+    if (difference > 1)
+    {
+        // Rotate C up
+        const int indexF = c.child1;
+        const int indexG = c.child2;
+        Node& f = m_nodes[indexF];
+        Node& g = m_nodes[indexG];
+
+        c.child1 = indexA;
+        c.parent = a.parent;
+        a.parent = indexC;
+
+        if (c.parent >= 0)
+        {
+            Node& parent = m_nodes[c.parent];
+            (parent.child1 == indexA ? parent.child1 : parent.child2) = indexC;
+        }
+        else
+        {
+            m_root = indexC;
+        }
+
+        // Keep the taller of C's children under C
+        const bool keepF = f.height > g.height;
+        const int indexKeep = keepF ? indexF : indexG;
+        const int indexMove = keepF ? indexG : indexF;
+        Node& keep = m_nodes[indexKeep];
+        Node& move = m_nodes[indexMove];
+
+        c.child2 = indexKeep;
+        a.child2 = indexMove;
+        move.parent = indexA;
+
+        a.bounds = b.bounds;
+        a.bounds.addBounds(move.bounds);
+        c.bounds = a.bounds;
+        c.bounds.addBounds(keep.bounds);
+
+        a.height = 1 + std::max(b.height, move.height);
+        c.height = 1 + std::max(a.height, keep.height);
+        return indexC;
+    }
+
+    if (difference < -1)
+    {
+        // Rotate B up
+        const int indexD = b.child1;
+        const int indexE = b.child2;
+        Node& d = m_nodes[indexD];
+        Node& e = m_nodes[indexE];
+
+        b.child1 = indexA;
+        b.parent = a.parent;
+        a.parent = indexB;
+
+        if (b.parent >= 0)
+        {
+            Node& parent = m_nodes[b.parent];
+            (parent.child1 == indexA ? parent.child1 : parent.child2) = indexB;
+        }
+        else
+        {
+            m_root = indexB;
+        }
+
+        // Keep the taller of B's children under B
+        const bool keepD = d.height > e.height;
+        const int indexKeep = keepD ? indexD : indexE;
+        const int indexMove = keepD ? indexE : indexD;
+        Node& keep = m_nodes[indexKeep];
+        Node& move = m_nodes[indexMove];
+
+        b.child2 = indexKeep;
+        a.child1 = indexMove;
+        move.parent = indexA;
+
+        a.bounds = c.bounds;
+        a.bounds.addBounds(move.bounds);
+        b.bounds = a.bounds;
+        b.bounds.addBounds(keep.bounds);
+
+        a.height = 1 + std::max(c.height, move.height);
+        b.height = 1 + std::max(a.height, keep.height);
+        return indexB;
+    }
+
+    return indexA;
+}
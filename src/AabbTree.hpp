@@ -0,0 +1,134 @@
+#pragma once
+
+#include "Aabb.hpp"
+
+#include <vector>
+#include <cassert>
+
+class Actor;
+
+// Dynamic bounding volume tree over the Actors of a Canvas, for spatial queries
+// NOTE leaves hold fattened bounds, so an Actor is only reinserted once it moves outside them
+class AabbTree
+{
+public:
+    static constexpr const float Margin = 0.5f; // fattening on each side of a leaf, in world units
+
+private:
+    struct Node
+    {
+        Aabb bounds;
+        Actor* actor = nullptr; // nullptr for inner nodes
+        int parent = -1; // next free node when not in use
+        int child1 = -1, child2 = -1;
+        int height = -1; // 0 for leaves, -1 when free
+        int order = 0; // position of the Actor in its Canvas
+        bool moved = false;
+
+        bool isLeaf() const {return child1 < 0;}
+    };
+
+    std::vector<Node> m_nodes;
+    std::vector<int> m_moved; // leaves whose Actors may have left their fat bounds
+    mutable std::vector<int> m_stack;
+    int m_root = -1;
+    int m_free = -1;
+
+public:
+    AabbTree() = default;
+    ~AabbTree() {}
+
+    // Add an Actor to the tree, or take it out again
+    void insert(Actor* actor);
+    void remove(Actor* actor);
+    void removeAll();
+
+    // Note that an Actor's bounds may have changed; refitted on the next update
+    void markMoved(Actor* actor);
+    void update();
+
+    void setOrder(Actor* actor, int order);
+    int getOrder(const Actor* actor) const;
+
+    int getHeight() const {return m_root >= 0 ? m_nodes[m_root].height : 0;}
+
+    // Visit Actors whose fat bounds touch the given bounds
+    // NOTE visit must not query the tree itself
+    template <class T> void query(const Aabb& bounds, T visit) const;
+
+    // Visit Actors whose fat bounds touch the segment from x1, y1 to x2, y2
+    // NOTE visit returns the fraction of the segment to clip the ray to
+    template <class T> void raycast(float x1, float y1, float x2, float y2, T visit) const;
+
+private:
+    int allocateNode();
+    void freeNode(int index);
+
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    void refit(int index);
+    int balance(int index);
+
+    static bool isTouching(const Aabb& a, const Aabb& b)
+        {return a.getLeft() <= b.getRight() && b.getLeft() <= a.getRight() && a.getTop() <= b.getBottom() && b.getTop() <= a.getBottom();}
+    static bool isTouching(const Aabb& bounds, float x, float y, float dx, float dy, float maxFraction);
+};
+
+template <class T>
+void AabbTree::query(const Aabb& bounds, T visit) const
+{
+    if (m_root < 0)
+        return;
+
+    m_stack.clear();
+    m_stack.push_back(m_root);
+    while (!m_stack.empty())
+    {
+        const Node& node = m_nodes[m_stack.back()];
+        m_stack.pop_back();
+
+        if (!isTouching(node.bounds, bounds))
+            continue;
+
+        if (node.isLeaf())
+        {
+            visit(node.actor);
+        }
+        else
+        {
+            m_stack.push_back(node.child1);
+            m_stack.push_back(node.child2);
+        }
+    }
+}
+
+template <class T>
+void AabbTree::raycast(float x1, float y1, float x2, float y2, T visit) const
+{
+    if (m_root < 0)
+        return;
+
+    const float dx = x2 - x1, dy = y2 - y1;
+    float maxFraction = 1.f;
+
+    m_stack.clear();
+    m_stack.push_back(m_root);
+    while (!m_stack.empty())
+    {
+        const Node& node = m_nodes[m_stack.back()];
+        m_stack.pop_back();
+
+        if (!isTouching(node.bounds, x1, y1, dx, dy, maxFraction))
+            continue;
+
+        if (node.isLeaf())
+        {
+            maxFraction = visit(node.actor, maxFraction);
+        }
+        else
+        {
+            m_stack.push_back(node.child1);
+            m_stack.push_back(node.child2);
+        }
+    }
+}
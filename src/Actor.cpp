@@ -30,16 +30,99 @@ Aabb Actor::getAabb() const
     w *= m_transform.getScaleX();
     h *= m_transform.getScaleY();
 
-    float x = m_transform.getX();
-    float y = m_transform.getY();
+    float x, y;
+    getPosition(x, y);
 
     return Aabb(x, y, x + w, y + h);
 }
 
+void Actor::getPosition(float& x, float& y) const
+{
+    if (m_pool)
+    {
+        x = m_pool->getPosX(m_body);
+        y = m_pool->getPosY(m_body);
+    }
+    else
+    {
+        x = m_transform.getX();
+        y = m_transform.getY();
+    }
+}
+
+void Actor::getVelocity(float& x, float& y) const
+{
+    if (m_pool)
+    {
+        x = m_pool->getVelX(m_body);
+        y = m_pool->getVelY(m_body);
+    }
+    else if (m_physics)
+    {
+        x = m_physics->getVelX();
+        y = m_physics->getVelY();
+    }
+    else
+    {
+        x = 0.f;
+        y = 0.f;
+    }
+}
+
+void Actor::setPosition(float x, float y)
+{
+    m_transform.setPosition(x, y);
+    if (m_pool)
+        m_pool->setPosition(m_body, x, y);
+    touch();
+}
+
+void Actor::setVelocity(float x, float y)
+{
+    if (m_pool)
+    {
+        m_pool->setVelocity(m_body, x, y);
+        if (x != 0.f || y != 0.f)
+            wake();
+        touch();
+    }
+    else if (m_physics)
+    {
+        m_physics->setVelX(x);
+        m_physics->setVelY(y);
+        touch();
+    }
+}
+
+void Actor::touch()
+{
+    ++m_version;
+
+    if (m_tree)
+        m_tree->markMoved(this);
+
+    // Canvas caches the bounds of colliders that aren't moving
+    if (m_canvas && m_collider && !isAwake())
+        m_canvas->invalidateColliders();
+}
+
+void Actor::wake()
+{
+    if (m_pool && m_pool->wake(m_body) && m_canvas)
+        m_canvas->invalidateColliders();
+}
+
+void Actor::syncTransform()
+{
+    // Positions are only stepped in the pool, so copy them over before the Transform is used
+    if (m_pool)
+        m_transform.setPosition(m_pool->getPosX(m_body), m_pool->getPosY(m_body));
+}
+
 void Actor::update(lua_State* L, float delta)
 {
     lua_pushnumber(L, delta);
-    pcall(L, "onUpdate", 1, 0);
+    pcall(L, OnUpdate, 1, 0);
 
     if (m_graphics)
         m_graphics->update(delta);
@@ -49,11 +132,18 @@ void Actor::update(lua_State* L, float delta)
         m_collider->update(delta);
 }
 
-void Actor::render(IRenderer* renderer)
+void Actor::render(IRenderer* renderer, float alpha)
 {
     // TODO check first if not visible and return early if so?
     assert(renderer != nullptr);
-    renderer->pushModelTransform(m_transform);
+    syncTransform();
+
+    // Draw bodies between their last two positions when stepping at a fixed rate
+    Transform transform = m_transform;
+    if (m_pool && alpha < 1.f)
+        transform.setPosition(m_pool->getPosX(m_body, alpha), m_pool->getPosY(m_body, alpha));
+    renderer->pushModelTransform(transform);
+    renderer->setLayer(m_layer);
     if (m_graphics)
         m_graphics->render(renderer);
     // TODO: render children? need to check if visible?
@@ -67,15 +157,18 @@ void Actor::render(IRenderer* renderer)
 
 bool Actor::mouseEvent(lua_State* L, bool down, float xl, float yl)//MouseEvent& event)
 {
-    return pcallT(L, "onClick", false, down, xl, yl);
+    return pcallT(L, OnClick, false, down, xl, yl);
 }
 
 void Actor::collideEvent(lua_State* L, Actor* with)
 {
-    // Push other Actor's full userdata on stack
+    // Push other Actor's full userdata on stack, unless there is no callback to pass it to
     assert(with != nullptr);
+    if (!hasCallback(OnCollide))
+        return;
+
     with->pushUserdata(L);
-    pcall(L, "onCollide", 1, 0);
+    pcall(L, OnCollide, 1, 0);
 }
 
 bool Actor::testMouse(float x, float y, float& xl, float& yl) const
@@ -163,14 +256,24 @@ void Actor::clone(lua_State* L, Actor* source)
     }
 
     if (source->m_physics)
+    {
         m_physics = PhysicsPtr(new Physics(*source->m_physics));
+        if (source->m_pool)
+            source->m_pool->load(source->m_body, *m_physics);
+    }
 
+    source->syncTransform();
     m_transform = source->m_transform;
     m_layer = source->m_layer;
 }
 
 void Actor::destroy(lua_State* L)
 {
+    if (m_pool)
+        m_pool->detach(this);
+    if (m_tree)
+        m_tree->remove(this);
+
     remove(L, m_graphics);
     remove(L, m_collider);
     remove(L, m_pathing);
@@ -183,8 +286,13 @@ void Actor::serialize(lua_State* L, Serializer* serializer, ObjectRef* ref)
     serializer->serializeMember(ref, "", "pathing", "setPathing", L, m_pathing);
 
     if (m_physics)
+    {
+        if (m_pool)
+            m_pool->load(m_body, *m_physics);
         m_physics->serialize(L, "physics", serializer, ref);
+    }
 
+    syncTransform();
     m_transform.serialize(L, "transform", serializer, ref);
 
     serializer->setNumber(ref, "", "layer", m_layer);
@@ -206,6 +314,7 @@ int Actor::actor_setGraphics(lua_State* L)
 {
     Actor* actor = Actor::checkUserdata(L, 1);
     actor->set(L, actor->m_graphics, 2);
+    actor->touch();
     return 0;
 }
 
@@ -218,7 +327,10 @@ int Actor::actor_getCollider(lua_State* L)
 int Actor::actor_setCollider(lua_State* L)
 {
     Actor* actor = Actor::checkUserdata(L, 1);
+    if (actor->m_canvas)
+        actor->m_canvas->invalidateColliders();
     actor->set(L, actor->m_collider, 2);
+    actor->touch();
     return 0;
 }
 
@@ -240,8 +352,10 @@ int Actor::actor_getPosition(lua_State* L)
     // Validate function arguments
     Actor* actor = Actor::checkUserdata(L, 1);
 
-    lua_pushnumber(L, actor->m_transform.getX());
-    lua_pushnumber(L, actor->m_transform.getY());
+    float x, y;
+    actor->getPosition(x, y);
+    lua_pushnumber(L, x);
+    lua_pushnumber(L, y);
     return 2;
 }
 
@@ -252,8 +366,7 @@ int Actor::actor_setPosition(lua_State* L)
     float x = static_cast<float>(luaL_checknumber(L, 2));
     float y = static_cast<float>(luaL_checknumber(L, 3));
 
-    actor->m_transform.setPosition(x, y);
-
+    actor->setPosition(x, y);
     return 0;
 }
 
@@ -265,6 +378,7 @@ int Actor::actor_setScale(lua_State* L)
     float sy = static_cast<float>(luaL_checknumber(L, 3));
 
     actor->m_transform.setScale(sx, sy);
+    actor->touch();
 
     return 0;
 }
@@ -291,12 +405,7 @@ int Actor::actor_setVelocity(lua_State* L)
     float x = static_cast<float>(luaL_checknumber(L, 2));
     float y = static_cast<float>(luaL_checknumber(L, 3));
 
-    if (actor->m_physics)
-    {
-        actor->m_physics->setVelX(x);
-        actor->m_physics->setVelY(y);
-    }
-
+    actor->setVelocity(x, y);
     return 0;
 }
 
@@ -305,18 +414,10 @@ int Actor::actor_getVelocity(lua_State* L)
     // Validate function arguments
     Actor* actor = Actor::checkUserdata(L, 1);
 
-    Physics* physics = actor->m_physics.get();
-    if (physics)
-    {
-        lua_pushnumber(L, physics->getVelX());
-        lua_pushnumber(L, physics->getVelY());
-    }
-    else
-    {
-        lua_pushnumber(L, 0.);
-        lua_pushnumber(L, 0.);
-    }
-
+    float x, y;
+    actor->getVelocity(x, y);
+    lua_pushnumber(L, x);
+    lua_pushnumber(L, y);
     return 2;
 }
 
@@ -327,7 +428,13 @@ int Actor::actor_addAcceleration(lua_State* L)
     float x = static_cast<float>(luaL_checknumber(L, 2));
     float y = static_cast<float>(luaL_checknumber(L, 3));
 
-    if (actor->m_physics)
+    if (actor->m_pool)
+    {
+        actor->m_pool->addAcceleration(actor->m_body, x, y);
+        if (x != 0.f || y != 0.f)
+            actor->wake();
+    }
+    else if (actor->m_physics)
     {
         actor->m_physics->addAccX(x);
         actor->m_physics->addAccY(y);
@@ -2,10 +2,13 @@
 
 #include "IUserdata.hpp"
 #include "Physics.hpp"
+#include "PhysicsPool.hpp"
+#include "AabbTree.hpp"
 #include "Transform.hpp"
 #include "Aabb.hpp"
 
 #include <memory>
+#include <cstdint>
 #include <cassert>
 
 struct lua_State;
@@ -19,6 +22,9 @@ class ResourceManager;
 
 class Actor : public TUserdata<Actor>
 {
+    friend class PhysicsPool;
+    friend class AabbTree;
+
     // TODO either make into a component or add directly to class
     typedef std::unique_ptr<Physics> PhysicsPtr;
 
@@ -27,32 +33,49 @@ public:
 
 private:
     Transform m_transform;
-    PhysicsPtr m_physics;
+    PhysicsPtr m_physics; // NOTE only up to date while not in a PhysicsPool
+    PhysicsPool* m_pool; // pool of the Canvas simulating this Actor, if any
+    int m_body; // index into m_pool
+    AabbTree* m_tree; // spatial index of the Canvas holding this Actor, if any
+    int m_proxy; // leaf in m_tree
     IGraphics* m_graphics;
     ICollider* m_collider;
     IPathing* m_pathing;
     int m_layer; // TODO: probably want to move this to graphics later
+    uint32_t m_version; // changed whenever motion or bounds are set from script
 
-    Actor(): m_canvas(nullptr), m_graphics(nullptr), m_collider(nullptr), m_pathing(nullptr), m_layer(0) {}
+    Actor(): m_canvas(nullptr), m_pool(nullptr), m_body(-1), m_tree(nullptr), m_proxy(-1), m_graphics(nullptr), m_collider(nullptr), m_pathing(nullptr), m_layer(0), m_version(0) {}
 
 public:
     ~Actor() {}
 
     ResourceManager* getResourceManager() const;
-    Transform& getTransform() {return m_transform;}
-    Physics* getPhysics() {return m_physics.get();}
-    const Physics* getPhysics() const {return m_physics.get();}
+    Transform& getTransform() {syncTransform(); return m_transform;}
+    bool hasPhysics() const {return m_physics != nullptr;}
+    bool isAwake() const {return m_pool && !m_pool->isAsleep(m_body);}
+    PhysicsPool* getPool() const {return m_pool;}
+    int getBody() const {return m_body;}
+    AabbTree* getTree() const {return m_tree;}
     const IGraphics* getGraphics() const {return m_graphics;}
     const ICollider* getCollider() const {return m_collider;}
     const IPathing* getPathing() const {return m_pathing;}
 
     Aabb getAabb() const;
+    void getPosition(float& x, float& y) const;
+    void getVelocity(float& x, float& y) const;
+    void setPosition(float x, float y);
+    void setVelocity(float x, float y); // NOTE does nothing without physics
 
     void setLayer(int layer) {m_layer = layer;}
     int getLayer() const {return m_layer;}
 
+    // NOTE Canvas compares versions to find out which predicted collisions are out of date
+    uint32_t getVersion() const {return m_version;}
+    void touch();
+    void wake();
+
     void update(lua_State* L, float delta);
-    void render(IRenderer* renderer);
+    void render(IRenderer* renderer, float alpha = 1.f); // NOTE alpha is how far bodies are through the current step
     bool mouseEvent(lua_State* L, bool down, float xl, float yl);
     void collideEvent(lua_State* L, Actor* with);
 
@@ -60,6 +83,8 @@ public:
     bool testCollision(float x, float y) const;
 
 private:
+    void syncTransform();
+
     template <class T> void set(lua_State* L, T*& component, int index);
     template <class T> void remove(lua_State* L, T*& component);
 
@@ -0,0 +1,83 @@
+#include "Broadphase.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+void Broadphase::resize(int count)
+{
+    assert(count >= 0);
+    if (count == getCount())
+        return;
+
+    // Proxies will map to different objects now, so the old order is no longer useful
+    m_bounds.resize(count, Aabb(0.f, 0.f, 0.f, 0.f));
+    m_order.resize(count);
+    for (int i = 0; i < count; ++i)
+        m_order[i] = i;
+    m_resized = true;
+}
+
+void Broadphase::sortOrder()
+{
+    auto compare = [this](int a, int b) {return m_bounds[a].getLeft() < m_bounds[b].getLeft();};
+
+    // Do a full sort when the proxies have changed
+    if (m_resized)
+    {
+        std::sort(m_order.begin(), m_order.end(), compare);
+        m_resized = false;
+        return;
+    }
+
+    // Otherwise bounds move very little between calls; insertion sort is close to linear here
+    const int count = int(m_order.size());
+    for (int i = 1; i < count; ++i)
+    {
+        const int index = m_order[i];
+        int j = i;
+        for (; j > 0 && compare(index, m_order[j-1]); --j)
+            m_order[j] = m_order[j-1];
+        m_order[j] = index;
+    }
+}
+
+void Broadphase::update()
+{
+    sortOrder();
+
+    const int count = int(m_order.size());
+    m_reach.resize(count);
+    for (int i = 0; i < count; ++i)
+        m_reach[i] = std::max(i > 0 ? m_reach[i-1] : m_bounds[m_order[i]].getRight(), m_bounds[m_order[i]].getRight());
+}
+
+const std::vector<Broadphase::Pair>& Broadphase::findPairs()
+{
+    sortOrder();
+    m_pairs.clear();
+
+    // Sweep along the x axis, only testing proxies until their left edge passes our right edge
+    // NOTE using inclusive tests so that touching bounds are reported conservatively
+    const int count = int(m_order.size());
+    for (int i = 0; i < count; ++i)
+    {
+        const int a = m_order[i];
+        const Aabb& boundsA = m_bounds[a];
+
+        for (int j = i + 1; j < count; ++j)
+        {
+            const int b = m_order[j];
+            const Aabb& boundsB = m_bounds[b];
+
+            if (boundsB.getLeft() > boundsA.getRight())
+                break;
+
+            if (isTouching(boundsA, boundsB))
+                m_pairs.emplace_back(std::min(a, b), std::max(a, b));
+        }
+    }
+
+    // Report in index order so callers can visit pairs the same way as a brute-force search
+    std::sort(m_pairs.begin(), m_pairs.end());
+    return m_pairs;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Aabb.hpp"
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cassert>
+
+// Sort-and-sweep over a set of bounds; reports the pairs of proxies that overlap
+class Broadphase
+{
+public:
+    typedef std::pair<int, int> Pair;
+
+private:
+    std::vector<Aabb> m_bounds;
+    std::vector<int> m_order; // proxy indices sorted by left edge
+    std::vector<Pair> m_pairs;
+    std::vector<float> m_reach; // furthest right edge of the proxies up to each point in m_order
+    bool m_resized = false;
+
+public:
+    Broadphase() = default;
+    ~Broadphase() {}
+
+    void resize(int count);
+    int getCount() const {return int(m_bounds.size());}
+
+    void setBounds(int index, const Aabb& bounds) {m_bounds[index] = bounds;}
+    const Aabb& getBounds(int index) const {return m_bounds[index];}
+
+    // NOTE uses the same inclusive test as findPairs
+    bool isTouching(int a, int b) const {return isTouching(m_bounds[a], m_bounds[b]);}
+
+    // NOTE pairs are ordered with first < second, sorted by first then second
+    const std::vector<Pair>& findPairs();
+
+    // Sort proxies after their bounds have been set, before any queries
+    void update();
+
+    // Visit proxies touching the given bounds, in order of their left edge
+    template <class T> void query(const Aabb& bounds, T visit) const;
+
+    static bool isTouching(const Aabb& a, const Aabb& b)
+        {return a.getLeft() <= b.getRight() && b.getLeft() <= a.getRight() && a.getTop() <= b.getBottom() && b.getTop() <= a.getBottom();}
+
+private:
+    void sortOrder();
+};
+
+template <class T>
+void Broadphase::query(const Aabb& bounds, T visit) const
+{
+    assert(!m_resized);
+
+    // Skip proxies that all end before our left edge
+    const int count = int(m_order.size());
+    int i = int(std::lower_bound(m_reach.begin(), m_reach.end(), bounds.getLeft()) - m_reach.begin());
+
+    for (; i < count; ++i)
+    {
+        const int index = m_order[i];
+        const Aabb& other = m_bounds[index];
+        if (other.getLeft() > bounds.getRight())
+            break;
+
+        if (isTouching(bounds, other))
+            visit(index);
+    }
+}
@@ -91,3 +91,10 @@ void Camera2D::mouseToWorld(const MouseEvent& event, float& x, float& y) const
     x = fractionX * m_transform.getScaleX() + m_transform.getX();
     y = fractionY * m_transform.getScaleY() + m_transform.getY();
 }
+
+Aabb Camera2D::getBounds() const
+{
+    const float x = m_transform.getX();
+    const float y = m_transform.getY();
+    return Aabb(x, y, x + m_transform.getScaleX(), y + m_transform.getScaleY());
+}
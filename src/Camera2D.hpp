@@ -29,6 +29,8 @@ public:
 
     void mouseToWorld(const MouseEvent& event, float& x, float& y) const override;
 
+    Aabb getBounds() const override;
+
 private:
     friend class TUserdata<Camera2D, ICamera>;
     void construct(lua_State* L);
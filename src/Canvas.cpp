@@ -3,18 +3,47 @@
 #include "Actor.hpp"
 #include "ICamera.hpp"
 #include "ICollider.hpp"
-#include "Physics.hpp"
 #include "Serializer.hpp"
 
 #include <algorithm>
+#include <functional>
+#include <chrono>
 #include <limits>
 #include <cmath>
 #include <string>
+#include <cassert>
+#include <cstdio>
 
 using namespace std::string_literals;
 
 const luaL_Reg Canvas::METHODS[];
 
+// Get bounds covering an Actor over the given time
+static Aabb getSweptAabb(const Actor* actor, float delta)
+{
+    Aabb bounds = actor->getAabb();
+
+    float velX, velY;
+    actor->getVelocity(velX, velY);
+    bounds.addSweep(velX * delta, velY * delta);
+
+    return bounds;
+}
+
+// Read a number from an array, keeping value if the element isn't a number
+static void getArrayNumber(lua_State* L, int index, int n, float& value)
+{
+    if (lua_rawgeti(L, index, n) == LUA_TNUMBER)
+        value = float(lua_tonumber(L, -1));
+    lua_pop(L, 1);
+}
+
+// Check if a collider belongs to any of the given groups; all bits set matches any collider
+static bool isInGroups(const ICollider* collider, uint32_t groups)
+{
+    return collider && (groups == 0xFFFFFFFF || (collider->getGroup() & groups) != 0);
+}
+
 ResourceManager* Canvas::getResourceManager() const
 {
     if (m_scene)
@@ -25,6 +54,9 @@ ResourceManager* Canvas::getResourceManager() const
 
 void Canvas::update(lua_State *L, float delta)
 {
+    // NOTE also while paused, so bodies aren't drawn between stale positions
+    m_bodies.savePositions();
+
     if (m_actorRemoved)
     {
         processRemovedActors(L);
@@ -36,10 +68,13 @@ void Canvas::update(lua_State *L, float delta)
     {
         // Call user-defined update method
         lua_pushnumber(L, delta);
-        pcall(L, "onUpdatePre", 1, 0);
+        pcall(L, OnUpdatePre, 1, 0);
 
         updatePhysics(L, delta);
 
+        // Systems run before Actors' own callbacks, with one call for all Actors of each
+        updateSystems(L, delta);
+
         // Order of update dispatch doesn't really matter; choose bottom to top
         for (auto& actor : m_actors)
             actor->update(L, delta);
@@ -47,14 +82,14 @@ void Canvas::update(lua_State *L, float delta)
         // Call user-defined update method
         // TODO is this necessary?
         lua_pushnumber(L, delta);
-        pcall(L, "onUpdatePost", 1, 0);
+        pcall(L, OnUpdatePost, 1, 0);
     }
 
     // Recently added Actors should now be added to the end
     processAddedActors(L);
 }
 
-void Canvas::render(IRenderer *renderer)
+void Canvas::render(IRenderer *renderer, float alpha)
 {
     // Don't render anything if Canvas is not visible
     if (!m_visible)
@@ -66,17 +101,28 @@ void Canvas::render(IRenderer *renderer)
 
     m_camera->preRender(renderer);
 
-    // TODO: add alternate structure to iterate in sorted order/down quadtree
+    // Only draw Actors overlapping the camera's view
+    // NOTE leaves are fitted to where bodies end the step, so when drawing part way through it the view is grown by the furthest any body moved
+    updateTree();
+    Aabb view = m_camera->getBounds();
+    if (alpha < 1.f)
+        view.addMargin(m_bodies.getMaxStep());
+    m_inView.clear();
+    m_tree.query(view, [this](Actor* actor) {m_inView.push_back(actor);});
+    std::sort(m_inView.begin(), m_inView.end(), [this](const Actor* a, const Actor* b) {return m_tree.getOrder(a) < m_tree.getOrder(b);});
+
     // NOTE: rendering most recently added last (on top)
-    auto end = m_actors.end();
-    for (auto it = m_actors.begin(); it != end; ++it)
+    m_visibleActors = 0;
+    for (auto& actor : m_inView)
     {
         // Skip Actor if it is marked for removal
-        if ((*it)->m_canvas != this)
+        if (actor->m_canvas != this)
             continue;
 
-        (*it)->render(renderer);
+        actor->render(renderer, alpha);
+        ++m_visibleActors;
     }
+    m_culledActors = int(m_actors.size()) - m_removedActors - m_visibleActors;
 
     m_camera->postRender(renderer);
 }
@@ -96,31 +142,37 @@ bool Canvas::mouseEvent(lua_State *L, MouseEvent& event)
     float x, y;
     m_camera->mouseToWorld(event, x, y);
 
-    if (pcallT(L, "onClickPre", false, event.down))
+    if (pcallT(L, OnClickPre, false, event.down))
         return true;
 
     float xl, yl;
 
+    // Only Actors whose bounds hold the click need testing
+    // NOTE callbacks may query the Canvas themselves, so candidates are kept in a list of our own
+    ActorVector hits;
+    updateTree();
+    m_tree.query(Aabb(x, y, x, y), [&hits](Actor* actor) {hits.push_back(actor);});
+
     // NOTE: iterate in reverse order of rendering
-    auto end = m_actors.rend();
-    for (auto it = m_actors.rbegin(); it != end; ++it)
+    std::sort(hits.begin(), hits.end(), [this](const Actor* a, const Actor* b) {return m_tree.getOrder(a) > m_tree.getOrder(b);});
+    for (auto& actor : hits)
     {
         // Skip Actor if it is marked for removal
-        if ((*it)->m_canvas != this)
+        if (actor->m_canvas != this)
             continue;
 
         // Query if click is inside Actor; could be combined with mouseEvent??
         // TODO: Actor should convert ray/point from world->object space
-        if (!(*it)->testMouse(x, y, xl, yl))
+        if (!actor->testMouse(x, y, xl, yl))
             continue;
 
         // TODO: try next actor down, or absorb the click?
-        //return (*it)->mouseEvent(L, event.down); // absorb the click
-        if ((*it)->mouseEvent(L, event.down, xl, yl))
+        //return actor->mouseEvent(L, event.down); // absorb the click
+        if (actor->mouseEvent(L, event.down, xl, yl))
             return true; // only absorb click if Actor chose to handle it
     }
 
-    if (pcallT(L, "onClickPost", false, event.down))
+    if (pcallT(L, OnClickPost, false, event.down))
         return true;
 
     return false;
@@ -134,6 +186,9 @@ void Canvas::resize(lua_State* /*L*/, int width, int height)
 
 void Canvas::processAddedActors(lua_State *L)
 {
+    if (!m_added.empty())
+        invalidateColliders();
+
     // Process each actor in the add queue
     for (auto& actor : m_added)
     {
@@ -153,14 +208,28 @@ void Canvas::processAddedActors(lua_State *L)
 
         // Insert actor before before one with greater layer (insertion sort)
         m_actors.insert(it, actor);
+        m_tree.insert(actor);
+
+        if (actor->hasPhysics())
+            m_bodies.attach(actor);
     }
 
     // All have been copied from the queue, so we clear it
+    if (!m_added.empty())
+    {
+        updateOrder();
+        m_systemsDirty = true;
+    }
     m_added.clear();
 }
 
 void Canvas::processRemovedActors(lua_State *L)
 {
+    invalidateColliders();
+    m_systemsDirty = true;
+
+    m_removedActors = 0;
+
     // Iterate through Actors to find any marked for delete
     auto end = m_actors.end();
     auto tail = m_actors.begin();
@@ -169,6 +238,10 @@ void Canvas::processRemovedActors(lua_State *L)
         // Remove actor if it is marked for delete, then skip
         if ((*it)->m_canvas != this)
         {
+            if ((*it)->getPool() == &m_bodies)
+                m_bodies.detach(*it);
+            if ((*it)->getTree() == &m_tree)
+                m_tree.remove(*it);
             releaseChild(L, *it);
             continue;
         }
@@ -181,118 +254,959 @@ void Canvas::processRemovedActors(lua_State *L)
 
     // If any Actors were removed, clear the end of the list
     if (tail != end)
+    {
         m_actors.erase(tail, end);
+        updateOrder();
+    }
 }
 
-void Canvas::updatePhysics(lua_State *L, float delta)
+void Canvas::updateSystems(lua_State* L, float delta)
 {
-    // Update physics state required before collisions
+    if (m_systemRemoved)
+        removeSystems(L);
+
+    if (m_systems.empty())
+        return;
+
+    if (m_systemsDirty || m_tagVersion != Scene::checkScene(L)->getTagVersion())
+        matchSystems(L);
+
+    // NOTE systems added by a system run in the same frame
+    for (int i = 0; i < int(m_systems.size()); ++i)
+    {
+        if (!m_systems[i].removed)
+            runSystem(L, i, delta);
+    }
+}
+
+void Canvas::runSystem(lua_State* L, int index, float delta)
+{
+    int top = lua_gettop(L);
+
+    // Get the system's entry (tag function actors positions velocities)
+    lua_rawgeti(L, LUA_REGISTRYINDEX, m_systemsRef);
+    lua_rawgeti(L, -1, index + 1);
+    lua_replace(L, -2);
+    const int entry = lua_gettop(L);
+    lua_rawgeti(L, entry, 3);
+    lua_rawgeti(L, entry, 4);
+    lua_rawgeti(L, entry, 5);
+    const int actors = entry + 1, positions = entry + 2, velocities = entry + 3;
+
+    // Pack Actors still in the Canvas into the arrays of last frame
+    // NOTE Actors are only written where they differ from last frame, as a system's Actors rarely change
+    System& system = m_systems[index];
+    const int previous = int(system.packed.size());
+    int count = 0;
+    system.values.clear();
+    for (auto& actor : system.actors)
+    {
+        if (actor->m_canvas != this)
+            continue;
+
+        if (count >= previous)
+            system.packed.push_back(nullptr);
+        if (system.packed[count] != actor)
+        {
+            system.packed[count] = actor;
+            actor->pushUserdata(L);
+            lua_rawseti(L, actors, count + 1);
+        }
+
+        float x, y, velX, velY;
+        actor->getPosition(x, y);
+        actor->getVelocity(velX, velY);
+        lua_pushnumber(L, x);
+        lua_rawseti(L, positions, count * 2 + 1);
+        lua_pushnumber(L, y);
+        lua_rawseti(L, positions, count * 2 + 2);
+        lua_pushnumber(L, velX);
+        lua_rawseti(L, velocities, count * 2 + 1);
+        lua_pushnumber(L, velY);
+        lua_rawseti(L, velocities, count * 2 + 2);
+        system.values.insert(system.values.end(), {x, y, velX, velY});
+        ++count;
+    }
+
+    // Clear what remains of last frame, so the length of the arrays is the count
+    for (int i = count; i < previous; ++i)
+    {
+        lua_pushnil(L);
+        lua_rawseti(L, actors, i + 1);
+        for (int j = 1; j <= 2; ++j)
+        {
+            lua_pushnil(L);
+            lua_rawseti(L, positions, i * 2 + j);
+            lua_pushnil(L);
+            lua_rawseti(L, velocities, i * 2 + j);
+        }
+    }
+    system.packed.resize(count);
+
+    // Call function(canvas, delta, actors, positions, velocities)
+    // NOTE the system limit is the same as a callback's, as a system stands in for many of them
+    lua_rawgeti(L, entry, 2);
+    pushUserdata(L);
+    lua_pushnumber(L, delta);
+    lua_pushvalue(L, actors);
+    lua_pushvalue(L, positions);
+    lua_pushvalue(L, velocities);
+
+    Scene* scene = Scene::checkScene(L);
+    scene->setWatchdog(30);
+    int rval = lua_pcall(L, 5, 0, 0);
+    scene->clearWatchdog();
+
+    if (rval != 0)
+    {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        lua_settop(L, top);
+        return;
+    }
+
+    // Read back positions and velocities, only setting those the script changed
+    // NOTE the script may have added systems, so the system is looked up again
+    System& written = m_systems[index];
+    for (int i = 0; i < count; ++i)
+    {
+        Actor* actor = written.packed[i];
+        if (actor->m_canvas != this)
+            continue;
+
+        const float* values = &written.values[i * 4];
+        float x = values[0], y = values[1], velX = values[2], velY = values[3];
+        getArrayNumber(L, positions, i * 2 + 1, x);
+        getArrayNumber(L, positions, i * 2 + 2, y);
+        getArrayNumber(L, velocities, i * 2 + 1, velX);
+        getArrayNumber(L, velocities, i * 2 + 2, velY);
+
+        if (x != values[0] || y != values[1])
+            actor->setPosition(x, y);
+        if (velX != values[2] || velY != values[3])
+            actor->setVelocity(velX, velY);
+    }
+
+    lua_settop(L, top);
+}
+
+void Canvas::matchSystems(lua_State* L)
+{
+    int top = lua_gettop(L);
+    const int count = int(m_systems.size());
+    luaL_checkstack(L, count + 4, nullptr);
+
+    // Push the tag of each system
+    lua_rawgeti(L, LUA_REGISTRYINDEX, m_systemsRef);
+    const int tags = lua_gettop(L) + 1;
+    for (int i = 0; i < count; ++i)
+    {
+        lua_rawgeti(L, tags - 1, i + 1);
+        lua_rawgeti(L, -1, 1);
+        lua_replace(L, -2);
+        m_systems[i].actors.clear();
+    }
+
+    // Compare each Actor's tag member with the tag of each system
+    lua_pushliteral(L, "tag");
+    const int key = lua_gettop(L);
     for (auto& actor : m_actors)
     {
-        // Always skip if marked for removal
         if (actor->m_canvas != this)
             continue;
 
-        Physics* physics = actor->getPhysics();
-        if (physics)
-            physics->preUpdate(delta);
+        actor->pushUserdata(L);
+        if (lua_getuservalue(L, -1) == LUA_TTABLE)
+        {
+            lua_pushvalue(L, key);
+            if (lua_rawget(L, -2) != LUA_TNIL)
+            {
+                for (int i = 0; i < count; ++i)
+                    if (lua_rawequal(L, -1, tags + i))
+                        m_systems[i].actors.push_back(actor);
+            }
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 2);
+    }
+
+    lua_settop(L, top);
+    m_tagVersion = Scene::checkScene(L)->getTagVersion();
+    m_systemsDirty = false;
+}
+
+void Canvas::removeSystems(lua_State* L)
+{
+    // Shift systems back over removed ones, in the Lua list as well
+    lua_rawgeti(L, LUA_REGISTRYINDEX, m_systemsRef);
+    const int count = int(m_systems.size());
+    int tail = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (m_systems[i].removed)
+            continue;
+
+        if (tail != i)
+        {
+            m_systems[tail] = std::move(m_systems[i]);
+            lua_rawgeti(L, -1, i + 1);
+            lua_rawseti(L, -2, tail + 1);
+        }
+        ++tail;
+    }
+
+    for (int i = tail; i < count; ++i)
+    {
+        lua_pushnil(L);
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_pop(L, 1);
+
+    m_systems.resize(tail);
+    m_systemRemoved = false;
+}
+
+void Canvas::updateTree()
+{
+    // Bodies are stepped without being touched, so any awake body may have moved
+    if (m_bodiesMoved)
+    {
+        for (int body = 0, count = m_bodies.getCount(); body < count; ++body)
+        {
+            Actor* actor = m_bodies.getActor(body);
+            if (!m_bodies.isAsleep(body) && actor->getTree() == &m_tree)
+                m_tree.markMoved(actor);
+        }
+        m_bodiesMoved = false;
     }
 
-    while (delta > 0.f)
+    m_tree.update();
+}
+
+void Canvas::updateOrder()
+{
+    // NOTE queries report hits in the same order as m_actors
+    for (int i = 0, count = int(m_actors.size()); i < count; ++i)
+    {
+        if (m_actors[i]->getTree() == &m_tree)
+            m_tree.setOrder(m_actors[i], i);
+    }
+}
+
+void Canvas::updatePhysics(lua_State *L, float delta)
+{
+    // Update physics state required before collisions
+    m_bodies.preUpdate(delta);
+
+    if (m_useBroadphase)
+        updateQueuedPhysics(L, delta);
+
+    while (!m_useBroadphase && delta > 0.f)
     {
-        bool found = false;
         Actor* actor1 = nullptr;
         Actor* actor2 = nullptr;
         float timeStart = delta, timeEnd, normX = 0.f, normY = 0.f;
+        const bool found = findFirstCollision(delta, actor1, actor2, timeStart, timeEnd, normX, normY);
 
-        // Iterate over all Actors
-        auto end = m_actors.end();
-        for (auto it = m_actors.begin(); it != end; ++it)
+        // Update all objects to first collision time
+        // TODO could avoid updating all objects by simulating reverse movement back to a common time when we check collisions??
+        if (timeStart > 0.f)
         {
-            // Always skip if marked for removal
-            if ((*it)->m_canvas != this)
-                continue;
+            advancePhysics(timeStart);
+            delta -= timeStart;
+        }
+
+        if (found)
+            resolveCollision(L, actor1, actor2, normX, normY);
+    }
+
+    // Refit while bodies that are about to sleep are still known to have moved
+    updateTree();
+
+    // Bodies that have come to rest are treated as static until woken
+    if (m_sleepVelocity > 0.f && m_bodies.updateSleep(m_sleepVelocity, m_sleepFrames))
+        invalidateColliders();
+}
+
+void Canvas::updateQueuedPhysics(lua_State *L, float delta)
+{
+    if (m_collidersDirty)
+        updateColliders();
+    m_rejectedPairs = 0;
+
+    // Bound the motion of each moving Actor over the whole frame
+    const int count = int(m_dynamic.size());
+    m_broadphase.resize(count);
+    for (int i = 0; i < count; ++i)
+    {
+        const int index = m_dynamic[i];
+        const Actor* actor = m_colliders[index];
+        m_broadphase.setBounds(i, getSweptAabb(actor, delta));
+        m_versions[index] = actor->getVersion();
+    }
+
+    // Predict collisions between moving Actors with overlapping bounds, and between them and static Actors
+    m_impacts.clear();
+    queueGroupImpacts(delta);
+    m_staticChanged = false;
+
+    float time = 0.f;
+    while (!m_impacts.empty())
+    {
+        std::pop_heap(m_impacts.begin(), m_impacts.end(), std::greater<Impact>());
+        const Impact impact = m_impacts.back();
+        m_impacts.pop_back();
+
+        // Skip stale predictions; either Actor may have changed course or been removed since
+        Actor* actor1 = m_colliders[impact.index1];
+        Actor* actor2 = m_colliders[impact.index2];
+        if (actor1->getVersion() != impact.version1 || actor2->getVersion() != impact.version2)
+            continue;
+        if (actor1->m_canvas != this || actor2->m_canvas != this)
+            continue;
+
+        // Update all objects to collision time
+        if (impact.time > time)
+        {
+            advancePhysics(impact.time - time);
+            time = impact.time;
+        }
+
+        // NOTE only bodies change course; predictions for static Actors remain valid
+        resolveCollision(L, actor1, actor2, impact.normX, impact.normY);
+        if (actor1->hasPhysics())
+            actor1->touch();
+        if (actor2->hasPhysics())
+            actor2->touch();
+
+        // Predict new collisions for both Actors, along with any others changed by callbacks
+        requeueChangedImpacts(time, delta);
+    }
+
+    // Update all objects to the end of the frame
+    if (time < delta)
+        advancePhysics(delta - time);
+}
+
+void Canvas::updateColliders()
+{
+    // Gather Actors with colliders, in the same order as the brute-force search
+    // NOTE non-collidable colliders are kept since callbacks may enable them mid-frame
+    m_colliders.clear();
+    for (auto& actor : m_actors)
+    {
+        if (actor->m_canvas == this && actor->getCollider())
+            m_colliders.push_back(actor);
+    }
+
+    for (auto& group : m_groups)
+    {
+        group.dynamic.clear();
+        group.statics.clear();
+        group.groups = 0;
+        group.reach = 0;
+    }
+
+    // Split colliders into awake bodies and everything else, bucketed by the lowest bit of their group
+    const int count = int(m_colliders.size());
+    m_dynamic.clear();
+    m_dynamicProxies.assign(count, -1);
+    m_staticProxies.assign(count, -1);
+    m_colliderGroups.assign(count, -1);
+    m_versions.resize(count);
+    for (int i = 0; i < count; ++i)
+    {
+        const Actor* actor = m_colliders[i];
+        const ICollider* collider = actor->getCollider();
+        m_versions[i] = actor->getVersion();
+
+        const bool awake = actor->isAwake();
+        if (awake)
+        {
+            m_dynamicProxies[i] = int(m_dynamic.size());
+            m_dynamic.push_back(i);
+        }
 
-            // Get earliest collision among remaining Actors
-            // TODO detect and stop repeated collision between stuck objects
-            // TODO add stuck flag to objects to treat as static while stuck
-            Actor* tempActor2;
-            float tempStart, tempEnd, tempNormX, tempNormY;
-            if (getEarliestCollision(*it, it+1, end, tempActor2, tempStart, tempEnd, tempNormX, tempNormY))
+        // NOTE colliders without a group can't collide with anything
+        const int index = getLowestGroup(collider->getGroup());
+        if (index < 0)
+            continue;
+
+        Group& group = m_groups[index];
+        group.groups |= collider->getGroup();
+        group.reach |= getGroupReach(collider);
+        m_colliderGroups[i] = index;
+        if (awake)
+        {
+            group.dynamic.push_back(i);
+        }
+        else
+        {
+            m_staticProxies[i] = int(group.statics.size());
+            group.statics.push_back(i);
+        }
+    }
+
+    // NOTE static bounds only change when an Actor is touched, which invalidates them again
+    for (auto& group : m_groups)
+    {
+        const int staticCount = int(group.statics.size());
+        group.staticPhase.resize(staticCount);
+        for (int i = 0; i < staticCount; ++i)
+            group.staticPhase.setBounds(i, m_colliders[group.statics[i]]->getAabb());
+        group.staticPhase.update();
+    }
+
+    m_collidersDirty = false;
+    m_staticChanged = false;
+}
+
+void Canvas::queueGroupImpacts(float delta)
+{
+    // Sort the moving Actors of each group
+    for (auto& group : m_groups)
+    {
+        const int count = int(group.dynamic.size());
+        group.dynamicPhase.resize(count);
+        for (int i = 0; i < count; ++i)
+            group.dynamicPhase.setBounds(i, m_broadphase.getBounds(m_dynamicProxies[group.dynamic[i]]));
+        group.dynamicPhase.update();
+    }
+
+    // Gather candidate pairs first, so they can be predicted in parallel
+    m_pairs.clear();
+    auto queue = [this](int index1, int index2)
+        {m_pairs.emplace_back(std::min(index1, index2), std::max(index1, index2));};
+
+    // Visit each pair of groups once, skipping those that can't collide
+    // NOTE pairs of static Actors are never considered; they have no relative velocity
+    m_culledPairs = 0;
+    for (int i = 0; i < GroupCount; ++i)
+    {
+        const Group& group1 = m_groups[i];
+        const int count1 = int(group1.dynamic.size());
+        if (count1 == 0)
+            continue;
+
+        for (int j = 0; j < GroupCount; ++j)
+        {
+            const Group& group2 = m_groups[j];
+            const int count2 = int(group2.dynamic.size());
+            const int staticCount2 = int(group2.statics.size());
+            const bool collidable = (group1.reach & group2.groups) && (group2.reach & group1.groups);
+
+            // Moving pairs within a group, or with a later group
+            if (j == i)
             {
-                // Note if we have found a new earliest collision
-                if (tempStart < timeStart)
+                if (!collidable)
+                    m_culledPairs += int64_t(count1) * (count1 - 1) / 2;
+                else
                 {
-                    found = true;
-                    actor1 = *it;
-                    actor2 = tempActor2;
-                    timeStart = tempStart;
-                    timeEnd = tempEnd;
-                    normX = tempNormX;
-                    normY = tempNormY;
+                    for (const auto& pair : m_groups[i].dynamicPhase.findPairs())
+                        queue(group1.dynamic[pair.first], group1.dynamic[pair.second]);
+                }
+            }
+            else if (j > i && count2 > 0)
+            {
+                if (!collidable)
+                    m_culledPairs += int64_t(count1) * count2;
+                else
+                {
+                    for (int k = 0; k < count1; ++k)
+                        group2.dynamicPhase.query(group1.dynamicPhase.getBounds(k), [&](int proxy) {queue(group1.dynamic[k], group2.dynamic[proxy]);});
+                }
+            }
+
+            // Moving against static
+            if (staticCount2 > 0)
+            {
+                if (!collidable)
+                    m_culledPairs += int64_t(count1) * staticCount2;
+                else
+                {
+                    for (int k = 0; k < count1; ++k)
+                        group2.staticPhase.query(group1.dynamicPhase.getBounds(k), [&](int proxy) {queue(group1.dynamic[k], group2.statics[proxy]);});
                 }
             }
         }
+    }
 
-        // Update all objects to first collision time
-        // TODO could avoid updating all objects by simulating reverse movement back to a common time when we check collisions??
-        if (timeStart > 0.f)
+    const int pairCount = int(m_pairs.size());
+    const int chunks = (pairCount + PredictChunk - 1) / PredictChunk;
+    if (m_workers && chunks > 1)
+    {
+        // Predict chunks of pairs in parallel, then queue in pair order exactly as the single threaded loop would
+        // NOTE the heap depends on the order of insertion, so this keeps simultaneous impacts resolved the same way
+        m_predicted.resize(chunks);
+        m_workers->run(chunks, [this, delta, pairCount](int chunk)
         {
-            for (auto& actor : m_actors)
+            Predicted& predicted = m_predicted[chunk];
+            predicted.impacts.clear();
+            predicted.rejected = 0;
+
+            Impact impact;
+            for (int i = chunk * PredictChunk, last = std::min(pairCount, (chunk + 1) * PredictChunk); i < last; ++i)
             {
-                Physics* physics = actor->getPhysics();
-                if (physics)
-                    physics->update(actor->getTransform(), timeStart);
+                if (predictImpact(m_pairs[i].first, m_pairs[i].second, 0.f, delta, impact, predicted.rejected))
+                    predicted.impacts.push_back(impact);
             }
+        });
 
-            delta -= timeStart;
+        for (const Predicted& predicted : m_predicted)
+        {
+            m_rejectedPairs += predicted.rejected;
+            for (const Impact& impact : predicted.impacts)
+            {
+                m_impacts.push_back(impact);
+                std::push_heap(m_impacts.begin(), m_impacts.end(), std::greater<Impact>());
+            }
         }
+    }
+    else
+    {
+        for (const auto& pair : m_pairs)
+            queueImpact(pair.first, pair.second, 0.f, delta);
+    }
+}
 
-        if (found)
+void Canvas::advancePhysics(float delta)
+{
+//#define PHYSICS_TIMING
+#ifdef PHYSICS_TIMING
+    using namespace std::chrono;
+    high_resolution_clock::time_point t1 = high_resolution_clock::now();
+#endif
+
+    m_bodies.advance(delta);
+    m_bodiesMoved = true;
+
+#ifdef PHYSICS_TIMING
+    // NOTE totals are reported about once a second of time spent advancing
+    high_resolution_clock::time_point t2 = high_resolution_clock::now();
+    static int64_t nsec = 0, bodies = 0;
+    nsec += duration_cast<nanoseconds>(t2 - t1).count();
+    bodies += m_bodies.getCount();
+    if (nsec > 1000000000)
+    {
+        fprintf(stderr, "advanced %lld bodies/sec\n", (long long)(bodies * 1000000000.0 / nsec));
+        nsec = bodies = 0;
+    }
+#endif
+}
+
+void Canvas::resolveCollision(lua_State *L, Actor* actor1, Actor* actor2, float normX, float normY)
+{
+    // Allow physics components to resolve collision
+    // NOTE Actors with physics are always in the pool while in m_actors
+    assert(!actor1->hasPhysics() || actor1->getPool() == &m_bodies);
+    assert(!actor2->hasPhysics() || actor2->getPool() == &m_bodies);
+    if (actor1->hasPhysics())
+        m_bodies.collide(actor1->getBody(), actor2->getBody(), normX, normY);
+    else if (actor2->hasPhysics())
+        m_bodies.collide(actor2->getBody(), actor1->getBody(), normX, normY);
+
+    // Contact wakes sleeping bodies
+    actor1->wake();
+    actor2->wake();
+
+    // Send collision notifications to script
+    actor1->collideEvent(L, actor2);
+    actor2->collideEvent(L, actor1);
+}
+
+bool Canvas::findFirstCollision(float delta, Actor*& actor1, Actor*& actor2, float& start, float& end, float& normX, float& normY)
+{
+    const int count = int(m_actors.size());
+    const int chunks = (count + ScanChunk - 1) / ScanChunk;
+
+    Earliest earliest;
+    if (m_workers && chunks > 1)
+    {
+        // Scan chunks of Actors in parallel, then merge in order exactly as the single threaded scan would
+        // NOTE later Actors test against fewer others, so chunks are handed out as workers free up
+        m_earliest.resize(chunks);
+        m_workers->run(chunks, [this, delta, count](int chunk)
+        {
+            findFirstCollision(delta, chunk * ScanChunk, std::min(count, (chunk + 1) * ScanChunk), m_earliest[chunk]);
+        });
+
+        earliest = m_earliest[0];
+        for (int chunk = 1; chunk < chunks; ++chunk)
+        {
+            if (m_earliest[chunk].found && (!earliest.found || m_earliest[chunk].start < earliest.start))
+                earliest = m_earliest[chunk];
+        }
+    }
+    else
+    {
+        findFirstCollision(delta, 0, count, earliest);
+    }
+
+    start = earliest.found ? earliest.start : delta;
+    if (!earliest.found)
+        return false;
+
+    actor1 = earliest.actor1;
+    actor2 = earliest.actor2;
+    end = earliest.end;
+    normX = earliest.normX;
+    normY = earliest.normY;
+    return true;
+}
+
+void Canvas::findFirstCollision(float delta, int first, int last, Earliest& earliest) const
+{
+    earliest.found = false;
+    earliest.start = delta;
+
+    Actor* tempActor2;
+    float tempStart, tempEnd, tempNormX, tempNormY;
+
+    // Iterate over a range of Actors
+    auto itEnd = m_actors.end();
+    for (auto it = m_actors.begin() + first, itLast = m_actors.begin() + last; it != itLast; ++it)
+    {
+        // Always skip if marked for removal
+        if ((*it)->m_canvas != this)
+            continue;
+
+        // Get earliest collision among remaining Actors
+        // TODO detect and stop repeated collision between stuck objects
+        // TODO add stuck flag to objects to treat as static while stuck
+        if (getEarliestCollision(*it, it+1, itEnd, tempActor2, tempStart, tempEnd, tempNormX, tempNormY))
+        {
+            // Note if we have found a new earliest collision
+            if (tempStart < earliest.start)
+            {
+                earliest.found = true;
+                earliest.actor1 = *it;
+                earliest.actor2 = tempActor2;
+                earliest.start = tempStart;
+                earliest.end = tempEnd;
+                earliest.normX = tempNormX;
+                earliest.normY = tempNormY;
+            }
+        }
+    }
+}
+
+void Canvas::setThreads(int threads)
+{
+    m_threads = std::max(threads, 0);
+
+    const int count = WorkerPool::getThreadCount(m_threads);
+    if (count > 1)
+        m_workers.reset(new WorkerPool(count));
+    else
+        m_workers.reset();
+}
+
+void Canvas::queueImpact(int index1, int index2, float time, float delta)
+{
+    Impact impact;
+    if (!predictImpact(index1, index2, time, delta, impact, m_rejectedPairs))
+        return;
+
+    m_impacts.push_back(impact);
+    std::push_heap(m_impacts.begin(), m_impacts.end(), std::greater<Impact>());
+}
+
+bool Canvas::predictImpact(int index1, int index2, float time, float delta, Impact& impact, int64_t& rejected) const
+{
+    assert(index1 < index2);
+    const Actor* actor1 = m_colliders[index1];
+    const Actor* actor2 = m_colliders[index2];
+
+    // Always skip if marked for removal
+    if (actor1->m_canvas != this || actor2->m_canvas != this)
+        return false;
+
+    const ICollider* collider1 = actor1->getCollider();
+    const ICollider* collider2 = actor2->getCollider();
+    if (!collider1 || !collider1->isCollidable() || !collider2)
+        return false;
+
+    // Reject pairs whose groups can't collide, before any of the motion math
+    if (!isGroupCollidable(collider1, collider2))
+    {
+        ++rejected;
+        return false;
+    }
+
+    // Compute the relative velocity (in frame of reference of other object)
+    float relVelX, relVelY, velX2, velY2;
+    actor1->getVelocity(relVelX, relVelY);
+    actor2->getVelocity(velX2, velY2);
+    relVelX -= velX2;
+    relVelY -= velY2;
+
+    // Reject potential collisions between non-moving objects (which we might not be able to resolve)
+    if (relVelX == 0.f && relVelY == 0.f)
+        return false;
+
+    // NOTE uses the same rules as getEarliestCollision for which collisions to consider
+    float start, end, normX, normY;
+    if (!collider1->getCollisionTime(relVelX, relVelY, collider2, delta - time, start, end, normX, normY))
+        return false;
+    if (end <= 0.f || start >= delta - time || (start < 0.f && end <= fabs(start)))
+        return false;
+
+    impact = {time + start, index1, index2, actor1->getVersion(), actor2->getVersion(), normX, normY};
+    return true;
+}
+
+void Canvas::requeueChangedImpacts(float time, float delta)
+{
+    // Find moving Actors that have changed since their collisions were predicted, and bound their new motion
+    m_changed.clear();
+    for (int i = 0, count = int(m_dynamic.size()); i < count; ++i)
+    {
+        const int index = m_dynamic[i];
+        const Actor* actor = m_colliders[index];
+        if (actor->getVersion() != m_versions[index])
         {
-            // Allow physics components to resolve collision
-            Physics* physics1 = actor1->getPhysics();
-            Physics* physics2 = actor2->getPhysics();
-            if (physics1)
-                physics1->collide(physics2, normX, normY);
-            else if (physics2)
-                physics2->collide(physics1, normX, normY);
-
-            // Send collision notifications to script
-            actor1->collideEvent(L, actor2);
-            actor2->collideEvent(L, actor1);
+            m_changed.push_back(index);
+            m_broadphase.setBounds(i, getSweptAabb(actor, delta - time));
         }
     }
+
+    if (m_staticChanged)
+        findChangedStatic(time, delta);
+
+    // Pairs of changed Actors are queued once, from the first of the pair
+    auto isSkipped = [this](int index, int changed)
+        {return index == changed || (index < changed && m_colliders[index]->getVersion() != m_versions[index]);};
+
+    // NOTE bounds of unchanged Actors still cover their motion for the rest of the frame
+    for (int changed : m_changed)
+    {
+        const int proxy = m_dynamicProxies[changed];
+        const Aabb& bounds = proxy >= 0 ? m_broadphase.getBounds(proxy) : m_groups[m_colliderGroups[changed]].staticPhase.getBounds(m_staticProxies[changed]);
+
+        for (int i = 0, count = int(m_dynamic.size()); i < count; ++i)
+        {
+            const int index = m_dynamic[i];
+            if (!isSkipped(index, changed) && Broadphase::isTouching(bounds, m_broadphase.getBounds(i)))
+                queueImpact(std::min(changed, index), std::max(changed, index), time, delta);
+        }
+
+        // Static Actors only need checking against moving ones
+        if (proxy < 0)
+            continue;
+
+        const ICollider* collider = m_colliders[changed]->getCollider();
+        const uint32_t groups = collider->getGroup();
+        const uint32_t reach = getGroupReach(collider);
+        for (const auto& group : m_groups)
+        {
+            if (group.statics.empty() || !(reach & group.groups) || !(group.reach & groups))
+                continue;
+
+            group.staticPhase.query(bounds, [&](int staticProxy)
+            {
+                const int index = group.statics[staticProxy];
+                if (m_dynamicProxies[index] < 0 && !isSkipped(index, changed))
+                    queueImpact(std::min(changed, index), std::max(changed, index), time, delta);
+            });
+        }
+    }
+
+    for (int changed : m_changed)
+        m_versions[changed] = m_colliders[changed]->getVersion();
+}
+
+void Canvas::findChangedStatic(float time, float delta)
+{
+    // Static Actors only change through script, or by being woken
+    for (auto& group : m_groups)
+    {
+        bool moved = false;
+        for (int i = 0, count = int(group.statics.size()); i < count; ++i)
+        {
+            const int index = group.statics[i];
+            const Actor* actor = m_colliders[index];
+            if (m_dynamicProxies[index] >= 0 || actor->getVersion() == m_versions[index])
+                continue;
+
+            m_changed.push_back(index);
+            if (actor->isAwake())
+            {
+                // Woken bodies join the moving ones for the rest of the frame; their static proxy is ignored from now on
+                const int proxy = int(m_dynamic.size());
+                m_dynamic.push_back(index);
+                m_dynamicProxies[index] = proxy;
+                m_broadphase.resize(proxy + 1);
+                m_broadphase.setBounds(proxy, getSweptAabb(actor, delta - time));
+            }
+            else
+            {
+                group.staticPhase.setBounds(i, actor->getAabb());
+                moved = true;
+            }
+        }
+
+        if (moved)
+            group.staticPhase.update();
+    }
+
+    m_staticChanged = false;
 }
 
-bool Canvas::testCollision(float deltaX, float deltaY, const Actor* actor1) const
+uint32_t Canvas::getGroupReach(const ICollider* collider) const
+{
+    // Groups any of the collider's groups may collide with, limited by its own mask
+    uint32_t reach = 0;
+    uint32_t groups = collider->getGroup();
+    for (int i = 0; groups != 0; ++i, groups >>= 1)
+    {
+        if (groups & 1)
+            reach |= m_groupMasks[i];
+    }
+
+    return reach & collider->getMask();
+}
+
+bool Canvas::isGroupCollidable(const ICollider* collider1, const ICollider* collider2) const
+{
+    return (getGroupReach(collider1) & collider2->getGroup()) && (getGroupReach(collider2) & collider1->getGroup());
+}
+
+int Canvas::getLowestGroup(uint32_t groups)
+{
+    if (groups == 0)
+        return -1;
+
+    int index = 0;
+    for (; !(groups & 1); groups >>= 1)
+        ++index;
+    return index;
+}
+
+bool Canvas::testCollision(float deltaX, float deltaY, const Actor* actor1)
 {
     const ICollider* collider1 = actor1->getCollider();
     if (!collider1 || !collider1->isCollidable())
         return false;
 
+    Aabb bounds = actor1->getAabb();
+    bounds.addOffset(deltaX, deltaY);
+
     // TODO: test just added actors as well?
-    for (auto& actor2 : m_actors)
+    bool found = false;
+    updateTree();
+    m_tree.query(bounds, [&](Actor* actor2)
     {
         // Always skip if marked for removal
-        if (actor2->m_canvas != this)
-            continue;
+        if (found || actor2->m_canvas != this)
+            return;
 
         // Don't allow collision with self
         if (actor1 == actor2)
-            continue;
+            return;
 
-        // Reject early if actor has no collider
+        // Reject early if actor has no collider, or its group can't collide
         const ICollider* collider2 = actor2->getCollider();
-        if (!collider2)
-            continue;
+        if (!collider2 || !isGroupCollidable(collider1, collider2))
+            return;
 
         // Test colliders against each other
-        if (collider1->testCollision(deltaX, deltaY, collider2))
-            return true;
+        found = collider1->testCollision(deltaX, deltaY, collider2);
+    });
+
+    return found;
+}
+
+void Canvas::queryPoint(float x, float y, uint32_t groups, ActorVector& hits)
+{
+    auto isHit = [this, x, y, groups](const Actor* actor)
+        {return actor->m_canvas == this && isInGroups(actor->getCollider(), groups) && actor->testCollision(x, y);};
+
+    const auto first = hits.size();
+    updateTree();
+    m_tree.query(Aabb(x, y, x, y), [&](Actor* actor)
+    {
+        if (isHit(actor))
+            hits.push_back(actor);
+    });
+    std::sort(hits.begin() + first, hits.end(), [this](const Actor* a, const Actor* b) {return m_tree.getOrder(a) < m_tree.getOrder(b);});
+
+    // NOTE: newly added Actors SHOULD be eligible for collision
+    for (auto& actor : m_added)
+    {
+        if (isHit(actor))
+            hits.push_back(actor);
+    }
+}
+
+void Canvas::queryRect(const Aabb& bounds, uint32_t groups, ActorVector& hits)
+{
+    auto isHit = [this, &bounds, groups](const Actor* actor)
+        {return actor->m_canvas == this && isInGroups(actor->getCollider(), groups) && actor->getCollider()->testCollision(bounds);};
+
+    const auto first = hits.size();
+    updateTree();
+    m_tree.query(bounds, [&](Actor* actor)
+    {
+        if (isHit(actor))
+            hits.push_back(actor);
+    });
+    std::sort(hits.begin() + first, hits.end(), [this](const Actor* a, const Actor* b) {return m_tree.getOrder(a) < m_tree.getOrder(b);});
+
+    for (auto& actor : m_added)
+    {
+        if (isHit(actor))
+            hits.push_back(actor);
     }
+}
 
-    return false;
+bool Canvas::raycast(float x1, float y1, float x2, float y2, uint32_t groups, Actor*& hit, float& fraction, float& normX, float& normY)
+{
+    // Sweep a point along the segment; the fraction is then the time of impact
+    const Aabb point(x1, y1, x1, y1);
+    const float dx = x2 - x1, dy = y2 - y1;
+    bool found = false;
+    int hitOrder = 0;
+    fraction = 1.f;
+
+    auto test = [&](Actor* actor, int order)
+    {
+        if (actor->m_canvas != this || !isInGroups(actor->getCollider(), groups))
+            return;
+
+        float start, end, tempNormX = 0.f, tempNormY = 0.f;
+        if (!actor->getCollider()->getCollisionTime(point, dx, dy, fraction, start, end, tempNormX, tempNormY) || end <= 0.f)
+            return;
+
+        // Starting inside a collider hits it straight away
+        if (start < 0.f)
+        {
+            start = 0.f;
+            tempNormX = tempNormY = 0.f;
+        }
+
+        // NOTE simultaneous hits go to the Actor drawn first, as with getCollision
+        if (start < fraction || (start == fraction && (!found || order < hitOrder)))
+        {
+            fraction = start;
+            normX = tempNormX;
+            normY = tempNormY;
+            hit = actor;
+            hitOrder = order;
+            found = true;
+        }
+    };
+
+    updateTree();
+    m_tree.raycast(x1, y1, x2, y2, [&](Actor* actor, float maxFraction)
+    {
+        test(actor, m_tree.getOrder(actor));
+        return found ? fraction : maxFraction;
+    });
+
+    const int count = int(m_actors.size());
+    for (int i = 0, added = int(m_added.size()); i < added; ++i)
+        test(m_added[i], count + i);
+
+    return found;
 }
 
 bool Canvas::getEarliestCollision(const Actor* actor1, ActorIterator it, ActorIterator itEnd, Actor*& hit, float& start, float& end, float& normX, float& normY) const
@@ -308,13 +1222,8 @@ bool Canvas::getEarliestCollision(const Actor* actor1, ActorIterator it, ActorIt
         return false;
 
     // Get Actor's velocity
-    const Physics* physics1 = actor1->getPhysics();
-    float velX = 0.f, velY = 0.f;
-    if (physics1)
-    {
-        velX = physics1->getVelX();
-        velY = physics1->getVelY();
-    }
+    float velX, velY;
+    actor1->getVelocity(velX, velY);
 
     for (; it != itEnd; ++it)
     {
@@ -328,26 +1237,23 @@ bool Canvas::getEarliestCollision(const Actor* actor1, ActorIterator it, ActorIt
         if (actor1 == actor2)
             continue;
 
-        // Reject early if actor has no collider
-        const ICollider* collider2 = actor2->getCollider();
-        if (!collider2)
-            continue;
-
         // Compute the relative velocity (in frame of reference of other object)
-        float relVelX = velX, relVelY = velY;
-        const Physics* physics2 = actor2->getPhysics();
-        if (physics2)
-        {
-            relVelX -= physics2->getVelX();
-            relVelY -= physics2->getVelY();
-        }
+        float relVelX, relVelY;
+        actor2->getVelocity(relVelX, relVelY);
+        relVelX = velX - relVelX;
+        relVelY = velY - relVelY;
 
         // Reject potential collisions between non-moving objects (which we might not be able to resolve)
         if (relVelX == 0.f && relVelY == 0.f)
             continue;
 
+        // Reject early if actor has no collider, or its group can't collide
+        const ICollider* collider2 = actor2->getCollider();
+        if (!collider2 || !isGroupCollidable(collider1, collider2))
+            continue;
+
         // Test colliders against each other
-        if (collider1->getCollisionTime(relVelX, relVelY, collider2, tempStart, tempEnd, tempNormX, tempNormY))
+        if (collider1->getCollisionTime(relVelX, relVelY, collider2, std::numeric_limits<float>::max(), tempStart, tempEnd, tempNormX, tempNormY))
         {
             // NOTE (tempStart < start || (tempStart == start && relPosY <= 0.f)) orders simultaneous collisions by order in the direction of movement
             // NOTE (tempStart >= 0.f || tempEnd > fabs(tempStart)) is a solution for only considering inward movemnt as collision
@@ -356,7 +1262,7 @@ bool Canvas::getEarliestCollision(const Actor* actor1, ActorIterator it, ActorIt
             {
                 // IDEA: return start time(s) in reverse sorted list; compare next in list until no longer equal (would need to store entire list on hit)
                 //relPosX = (actor2->getTransform().getX() - hit->getTransform().getX()) * relVelX;
-                relPosY = (actor2->getTransform().getY() - hit->getTransform().getY()) * relVelY;
+                relPosY = (actor2->getAabb().getTop() - hit->getAabb().getTop()) * relVelY;
             }
             if (tempEnd > 0.f
                 && (tempStart < start || (tempStart == start /*&& relPosX <= 0.f*/ && relPosY <= 0.f))
@@ -389,6 +1295,15 @@ void Canvas::construct(lua_State* L)
 
     getValueOpt(L, 2, "paused", m_paused);
     getValueOpt(L, 2, "visible", m_visible);
+    getValueOpt(L, 2, "broadphase", m_useBroadphase);
+    getValueOpt(L, 2, "sleepVelocity", m_sleepVelocity);
+    getValueOpt(L, 2, "sleepFrames", m_sleepFrames);
+    getVectorOpt(L, 2, "collisionMatrix", m_groupMasks);
+    m_sleepFrames = std::min(std::max(m_sleepFrames, 1), int(std::numeric_limits<uint16_t>::max()));
+
+    int threads = m_threads;
+    getValueOpt(L, 2, "threads", threads);
+    setThreads(threads);
 }
 
 void Canvas::clone(lua_State* L, Canvas* source)
@@ -413,7 +1328,12 @@ void Canvas::clone(lua_State* L, Canvas* source)
         lua_pop(L, 1);
         ptr->m_canvas = this;
         m_actors.push_back(ptr);
+        m_tree.insert(ptr);
+
+        if (ptr->hasPhysics())
+            m_bodies.attach(ptr);
     }
+    updateOrder();
 
     for (auto& actor : source->m_added)
     {
@@ -431,10 +1351,22 @@ void Canvas::clone(lua_State* L, Canvas* source)
 
     m_paused = source->m_paused;
     m_visible = source->m_visible;
+    m_useBroadphase = source->m_useBroadphase;
+    m_sleepVelocity = source->m_sleepVelocity;
+    m_sleepFrames = source->m_sleepFrames;
+    m_groupMasks = source->m_groupMasks;
+    setThreads(source->m_threads);
 }
 
-void Canvas::destroy(lua_State* /*L*/)
+void Canvas::destroy(lua_State* L)
 {
+    if (m_systemsRef != LUA_NOREF)
+        luaL_unref(L, LUA_REGISTRYINDEX, m_systemsRef);
+
+    // Hand physics state back to the Actors, which may outlive the Canvas
+    m_bodies.detachAll();
+    m_tree.removeAll();
+
     // Mark each Actor in primary list for removal
     for (auto& actor : m_actors)
     {
@@ -474,6 +1406,11 @@ void Canvas::serialize(lua_State* L, Serializer* serializer, ObjectRef* ref)
 
     serializer->setBoolean(ref, "", "paused", m_paused);
     serializer->setBoolean(ref, "", "visible", m_visible);
+    serializer->setBoolean(ref, "", "broadphase", m_useBroadphase);
+    serializer->setNumber(ref, "", "sleepVelocity", m_sleepVelocity);
+    serializer->setNumber(ref, "", "sleepFrames", m_sleepFrames);
+    serializer->setVector(ref, "", "collisionMatrix", m_groupMasks);
+    serializer->setNumber(ref, "", "threads", m_threads);
 }
 
 int Canvas::canvas_addActor(lua_State *L)
@@ -493,14 +1430,23 @@ int Canvas::canvas_addActor(lua_State *L)
     // NOTE: this will prevent duplicates and faulty ref counts
     auto& actors = canvas->m_actors;
     auto& added = canvas->m_added;
-    if (std::find(actors.begin(), actors.end(), actor) == actors.end() &&
-        std::find(added.begin(), added.end(), actor) == added.end())
+    const bool pending = std::find(actors.begin(), actors.end(), actor) != actors.end();
+    if (!pending && std::find(added.begin(), added.end(), actor) == added.end())
     {
         // Queue up the add; will take affect after the update loop
         canvas->m_added.push_back(actor);
         canvas->acquireChild(L, actor, 2);
     }
 
+    // Take back physics and bounds from any Canvas the Actor was moved to in the meantime
+    if (pending && actor->hasPhysics())
+        canvas->m_bodies.attach(actor);
+    if (pending && actor->getTree() != &canvas->m_tree)
+    {
+        canvas->m_tree.insert(actor);
+        canvas->updateOrder();
+    }
+
     // Finally, mark Actor as added to this Canvas
     actor->m_canvas = canvas;
 
@@ -521,6 +1467,9 @@ int Canvas::canvas_removeActor(lua_State *L)
     // Mark Actor for later removal (after we're done iterating)
     if (isOwner)
     {
+        // NOTE Actors still in the add queue were never drawn, so aren't counted
+        if (actor->getTree() == &canvas->m_tree)
+            ++canvas->m_removedActors;
         canvas->m_actorRemoved = true;
         actor->m_canvas = nullptr;
     }
@@ -536,8 +1485,13 @@ int Canvas::canvas_clear(lua_State* L)
 
     // Mark each Actor belonging to primary list for removal
     for (auto& actor : canvas->m_actors)
+    {
         if (actor->m_canvas == canvas)
+        {
             actor->m_canvas = nullptr;
+            ++canvas->m_removedActors;
+        }
+    }
 
     // Mark each actor belonging to pending list for removal
     for (auto& actor : canvas->m_added)
@@ -550,6 +1504,73 @@ int Canvas::canvas_clear(lua_State* L)
     return 0;
 }
 
+int Canvas::canvas_addSystem(lua_State* L)
+{
+    // Validate function arguments
+    Canvas* canvas = Canvas::checkUserdata(L, 1);
+    luaL_argcheck(L, !lua_isnoneornil(L, 2), 2, "tag required");
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+
+    // Create the list of systems on first use
+    if (canvas->m_systemsRef == LUA_NOREF)
+    {
+        lua_newtable(L);
+        canvas->m_systemsRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    // Keep the tag and function along with the arrays passed to the function, which are reused every frame
+    lua_rawgeti(L, LUA_REGISTRYINDEX, canvas->m_systemsRef);
+    lua_createtable(L, 5, 0);
+    lua_pushvalue(L, 2);
+    lua_rawseti(L, -2, 1);
+    lua_pushvalue(L, 3);
+    lua_rawseti(L, -2, 2);
+    for (int i = 3; i <= 5; ++i)
+    {
+        lua_newtable(L);
+        lua_rawseti(L, -2, i);
+    }
+    lua_rawseti(L, -2, int(canvas->m_systems.size()) + 1);
+    lua_pop(L, 1);
+
+    canvas->m_systems.emplace_back();
+    canvas->m_systemsDirty = true;
+
+    return 0;
+}
+
+int Canvas::canvas_removeSystem(lua_State* L)
+{
+    // Validate function arguments
+    Canvas* canvas = Canvas::checkUserdata(L, 1);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+
+    // Mark the first system calling the function for removal before systems next run
+    bool found = false;
+    if (canvas->m_systemsRef != LUA_NOREF)
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, canvas->m_systemsRef);
+        for (int i = 0, count = int(canvas->m_systems.size()); i < count && !found; ++i)
+        {
+            if (canvas->m_systems[i].removed)
+                continue;
+
+            lua_rawgeti(L, -1, i + 1);
+            lua_rawgeti(L, -1, 2);
+            found = lua_rawequal(L, -1, 2) != 0;
+            lua_pop(L, 2);
+
+            canvas->m_systems[i].removed = found;
+        }
+        lua_pop(L, 1);
+    }
+
+    canvas->m_systemRemoved |= found;
+
+    lua_pushboolean(L, found);
+    return 1;
+}
+
 int Canvas::canvas_getCamera(lua_State* L)
 {
     Canvas* canvas = Canvas::checkUserdata(L, 1);
@@ -607,37 +1628,79 @@ int Canvas::canvas_getCollision(lua_State* L)
     float x = static_cast<float>(luaL_checknumber(L, 2));
     float y = static_cast<float>(luaL_checknumber(L, 3));
 
-    // TODO return list of collisions instead of just first collision?
-    for (auto& actor : canvas->m_actors)
-    {
-        // Always skip if marked for removal
-        if (actor->m_canvas != canvas)
-            continue;
+    // NOTE see queryPoint for a list of all collisions
+    canvas->m_hits.clear();
+    canvas->queryPoint(x, y, 0xFFFFFFFF, canvas->m_hits);
+    if (canvas->m_hits.empty())
+        return 0;
 
-        // If we find a collision, push the Actor and return
-        if (actor->testCollision(x, y))
-        {
-            actor->pushUserdata(L);
-            return 1;
-        }
-    }
+    canvas->m_hits.front()->pushUserdata(L);
+    return 1;
+}
 
-    // NOTE: newly added Actors SHOULD be eligible for collision
-    for (auto& actor : canvas->m_added)
+// Push a list of Actors as an array
+static int pushActors(lua_State* L, const std::vector<Actor*>& actors)
+{
+    lua_createtable(L, int(actors.size()), 0);
+    for (int i = 0, count = int(actors.size()); i < count; ++i)
     {
-        // Always skip if marked for removal
-        if (actor->m_canvas != canvas)
-            continue;
-
-        // If we find a collision, push the Actor and return
-        if (actor->testCollision(x, y))
-        {
-            actor->pushUserdata(L);
-            return 1;
-        }
+        actors[i]->pushUserdata(L);
+        lua_rawseti(L, -2, i + 1);
     }
+    return 1;
+}
 
-    return 0;
+int Canvas::canvas_queryPoint(lua_State* L)
+{
+    // Validate function arguments
+    Canvas *canvas = Canvas::checkUserdata(L, 1);
+    float x = static_cast<float>(luaL_checknumber(L, 2));
+    float y = static_cast<float>(luaL_checknumber(L, 3));
+    uint32_t groups = uint32_t(luaL_optinteger(L, 4, 0xFFFFFFFF));
+
+    canvas->m_hits.clear();
+    canvas->queryPoint(x, y, groups, canvas->m_hits);
+    return pushActors(L, canvas->m_hits);
+}
+
+int Canvas::canvas_queryRect(lua_State* L)
+{
+    // Validate function arguments
+    Canvas *canvas = Canvas::checkUserdata(L, 1);
+    float x = static_cast<float>(luaL_checknumber(L, 2));
+    float y = static_cast<float>(luaL_checknumber(L, 3));
+    float w = static_cast<float>(luaL_checknumber(L, 4));
+    float h = static_cast<float>(luaL_checknumber(L, 5));
+    uint32_t groups = uint32_t(luaL_optinteger(L, 6, 0xFFFFFFFF));
+    luaL_argcheck(L, w >= 0.f, 4, "must be non-negative\n");
+    luaL_argcheck(L, h >= 0.f, 5, "must be non-negative\n");
+
+    canvas->m_hits.clear();
+    canvas->queryRect(Aabb(x, y, x + w, y + h), groups, canvas->m_hits);
+    return pushActors(L, canvas->m_hits);
+}
+
+int Canvas::canvas_raycast(lua_State* L)
+{
+    // Validate function arguments
+    Canvas *canvas = Canvas::checkUserdata(L, 1);
+    float x1 = static_cast<float>(luaL_checknumber(L, 2));
+    float y1 = static_cast<float>(luaL_checknumber(L, 3));
+    float x2 = static_cast<float>(luaL_checknumber(L, 4));
+    float y2 = static_cast<float>(luaL_checknumber(L, 5));
+    uint32_t groups = uint32_t(luaL_optinteger(L, 6, 0xFFFFFFFF));
+
+    Actor* hit = nullptr;
+    float fraction, normX = 0.f, normY = 0.f;
+    if (!canvas->raycast(x1, y1, x2, y2, groups, hit, fraction, normX, normY))
+        return 0;
+
+    hit->pushUserdata(L);
+    lua_pushnumber(L, x1 + (x2 - x1) * fraction);
+    lua_pushnumber(L, y1 + (y2 - y1) * fraction);
+    lua_pushnumber(L, normX);
+    lua_pushnumber(L, normY);
+    return 5;
 }
 
 int Canvas::canvas_setPaused(lua_State *L)
@@ -661,3 +1724,52 @@ int Canvas::canvas_setVisible(lua_State *L)
 
     return 0;
 }
+
+int Canvas::canvas_getGroupMask(lua_State *L)
+{
+    // Validate function arguments
+    Canvas *canvas = Canvas::checkUserdata(L, 1);
+    const int index = getLowestGroup(uint32_t(luaL_checkinteger(L, 2)));
+    luaL_argcheck(L, index >= 0, 2, "must be a non-zero group\n");
+
+    lua_pushinteger(L, canvas->m_groupMasks[index]);
+    return 1;
+}
+
+int Canvas::canvas_setGroupMask(lua_State *L)
+{
+    // Validate function arguments
+    Canvas *canvas = Canvas::checkUserdata(L, 1);
+    uint32_t groups = uint32_t(luaL_checkinteger(L, 2));
+    const uint32_t mask = uint32_t(luaL_checkinteger(L, 3));
+
+    // NOTE applies to every group set in groups
+    for (int i = 0; groups != 0; ++i, groups >>= 1)
+    {
+        if (groups & 1)
+            canvas->m_groupMasks[i] = mask;
+    }
+    canvas->invalidateColliders();
+
+    return 0;
+}
+
+int Canvas::canvas_getCulledPairs(lua_State *L)
+{
+    // Validate function arguments
+    Canvas *canvas = Canvas::checkUserdata(L, 1);
+
+    lua_pushinteger(L, canvas->m_culledPairs);
+    lua_pushinteger(L, canvas->m_rejectedPairs);
+    return 2;
+}
+
+int Canvas::canvas_getCulledActors(lua_State *L)
+{
+    // Validate function arguments
+    Canvas *canvas = Canvas::checkUserdata(L, 1);
+
+    lua_pushinteger(L, canvas->m_culledActors);
+    lua_pushinteger(L, canvas->m_visibleActors);
+    return 2;
+}
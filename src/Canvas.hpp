@@ -2,14 +2,20 @@
 
 #include "IUserdata.hpp"
 #include "Event.hpp"
+#include "Broadphase.hpp"
+#include "PhysicsPool.hpp"
+#include "AabbTree.hpp"
+#include "WorkerPool.hpp"
 
 #include <vector>
 #include <memory>
+#include <cstdint>
 #include "lua.h"
 
 class Scene;
 class Actor;
 class ICamera;
+class ICollider;
 class IRenderer;
 class ResourceManager;
 
@@ -20,13 +26,105 @@ class Canvas : public TUserdata<Canvas>
     typedef std::vector<Actor*> ActorVector;
     typedef ActorVector::const_iterator ActorIterator;
 
+    // Predicted collision between two Actors in m_colliders, queued by time of impact
+    struct Impact
+    {
+        float time; // time since the start of the frame
+        int index1, index2; // NOTE index1 < index2
+        uint32_t version1, version2; // Actor versions at the time of prediction
+        float normX, normY;
+
+        // NOTE simultaneous impacts are resolved in collider order
+        bool operator>(const Impact& other) const
+            {return time != other.time ? time > other.time : index1 != other.index1 ? index1 > other.index1 : index2 > other.index2;}
+    };
+
+    // Earliest collision found by a scan over a range of Actors
+    struct Earliest
+    {
+        Actor* actor1;
+        Actor* actor2;
+        float start, end;
+        float normX, normY;
+        bool found;
+    };
+
+    // Collisions predicted by a task over a range of candidate pairs
+    struct Predicted
+    {
+        std::vector<Impact> impacts; // in the order of the pairs
+        int64_t rejected;
+    };
+
+    // Script function called once per frame with all Actors whose tag member matches the system's tag
+    // NOTE the tag, function and arrays passed to it are kept in the Lua list at m_systemsRef, at the same index
+    // NOTE systems aren't cloned or serialized with the Canvas
+    struct System
+    {
+        ActorVector actors; // matching Actors in update order; found again when Actors or tags change
+        ActorVector packed; // Actors in the script's array, as written last frame
+        std::vector<float> values; // position and velocity of each packed Actor as written, to find those changed by the script
+        bool removed = false; // NOTE removal is deferred so indices stay valid while systems run
+    };
+
+    static constexpr const int GroupCount = 32;
+    static constexpr const int ScanChunk = 64; // Actors scanned by each task when finding the first collision in parallel
+    static constexpr const int PredictChunk = 256; // candidate pairs predicted by each task when queueing impacts in parallel
+
+    // Colliders bucketed by the lowest bit of their collision group
+    struct Group
+    {
+        std::vector<int> dynamic; // indices into m_colliders of awake bodies
+        std::vector<int> statics; // indices into m_colliders of everything else
+        Broadphase dynamicPhase;
+        Broadphase staticPhase; // NOTE only rebuilt when colliders are invalidated
+        uint32_t groups = 0; // all group bits of members
+        uint32_t reach = 0; // all groups members may collide with
+    };
+
     ActorVector m_actors;
     ActorVector m_added;
+    ActorVector m_colliders; // Actors with colliders, in the same order as m_actors
+    std::vector<int> m_dynamic; // colliders of awake bodies, indexed by m_broadphase
+    std::vector<int> m_dynamicProxies; // index into m_dynamic for each collider, or -1
+    std::vector<int> m_staticProxies; // index into its group's statics for each collider, or -1
+    std::vector<int> m_colliderGroups; // index into m_groups for each collider, or -1
+    Broadphase m_broadphase;
+    Group m_groups[GroupCount];
+    std::vector<uint32_t> m_groupMasks = std::vector<uint32_t>(GroupCount, 0xFFFFFFFF); // collision matrix; groups each group may collide with
+    int64_t m_culledPairs = 0; // pairs never enumerated last frame because their groups can't collide
+    int64_t m_rejectedPairs = 0; // overlapping pairs rejected last frame by group or mask
+    std::vector<Impact> m_impacts; // min-heap of predicted collisions
+    std::vector<std::pair<int, int>> m_pairs; // candidate pairs found at the start of the frame, in broadphase order
+    std::vector<uint32_t> m_versions; // Actor versions when their collisions were last predicted
+    std::vector<int> m_changed;
+    PhysicsPool m_bodies; // physics state of Actors in m_actors
+    AabbTree m_tree; // bounds of Actors in m_actors, for spatial queries
+    std::unique_ptr<WorkerPool> m_workers; // only when using more than one thread
+    std::vector<Earliest> m_earliest; // per task results of findFirstCollision
+    std::vector<Predicted> m_predicted; // per task results of queueGroupImpacts
+    ActorVector m_hits; // scratch list of query results
+    ActorVector m_inView; // Actors overlapping the camera's view, in draw order
+    int m_visibleActors = 0; // Actors drawn last frame
+    int m_culledActors = 0; // Actors skipped last frame because they were out of view
+    int m_removedActors = 0; // Actors in m_actors marked for removal; still in m_tree until the next update
+    std::vector<System> m_systems;
+    int m_systemsRef = LUA_NOREF; // registry ref to the list of {tag, function, actors, positions, velocities} of each system
+    uint32_t m_tagVersion = 0; // Scene tag version when systems were last matched
+    bool m_systemsDirty = false; // Actors were added or removed since systems were last matched
+    bool m_systemRemoved = false;
     ICamera* m_camera = nullptr;
     Scene* m_scene = nullptr;
     bool m_paused = false;
     bool m_visible = true;
     bool m_actorRemoved = false;
+    bool m_useBroadphase = true; // false to test every pair of Actors after every collision (for comparison)
+    bool m_collidersDirty = true;
+    bool m_staticChanged = false; // a static collider was touched or woken since the last prediction
+    bool m_bodiesMoved = false; // bodies have advanced since m_tree was last updated
+    float m_sleepVelocity = 0.01f; // bodies slower than this for m_sleepFrames are put to sleep
+    int m_sleepFrames = 60;
+    int m_threads = 1; // threads used to predict collisions, or find the first without the broadphase; 0 for one per core
 
     Canvas() = default;
 
@@ -36,17 +134,50 @@ public:
     ResourceManager* getResourceManager() const;
 
     void update(lua_State* L, float delta);
-    void render(IRenderer* renderer);
+    void render(IRenderer* renderer, float alpha = 1.f);
     bool mouseEvent(lua_State* L, MouseEvent& event);
     void resize(lua_State* L, int width, int height);
 
+    // Called when the set of colliders changes, or a collider that isn't moving is changed
+    void invalidateColliders() {m_collidersDirty = true; m_staticChanged = true;}
+
 private:
     void processAddedActors(lua_State *L);
     void processRemovedActors(lua_State *L);
+    void updateTree();
+    void updateOrder();
+    void updateSystems(lua_State* L, float delta);
+    void runSystem(lua_State* L, int index, float delta);
+    void matchSystems(lua_State* L);
+    void removeSystems(lua_State* L);
     void updatePhysics(lua_State *L, float delta);
+    void updateQueuedPhysics(lua_State *L, float delta);
+    void updateColliders();
+    void queueGroupImpacts(float delta);
+    void advancePhysics(float delta);
+    void resolveCollision(lua_State *L, Actor* actor1, Actor* actor2, float normX, float normY);
+    bool findFirstCollision(float delta, Actor*& actor1, Actor*& actor2, float& start, float& end, float& normX, float& normY);
+    void findFirstCollision(float delta, int first, int last, Earliest& earliest) const;
+    void setThreads(int threads);
+    void queueImpact(int index1, int index2, float time, float delta);
+    bool predictImpact(int index1, int index2, float time, float delta, Impact& impact, int64_t& rejected) const;
+    void requeueChangedImpacts(float time, float delta);
+    void findChangedStatic(float time, float delta);
+
+    uint32_t getGroupReach(const ICollider* collider) const;
+    bool isGroupCollidable(const ICollider* collider1, const ICollider* collider2) const;
+    static int getLowestGroup(uint32_t groups);
 
 public:
-    bool testCollision(float deltaX, float deltaY, const Actor* actor1) const;
+    bool testCollision(float deltaX, float deltaY, const Actor* actor1);
+
+    // Find all Actors in draw order (newly added last) with colliders in any of the given groups hit by a point or rect
+    void queryPoint(float x, float y, uint32_t groups, ActorVector& hits);
+    void queryRect(const Aabb& bounds, uint32_t groups, ActorVector& hits);
+
+    // Find the first collider in any of the given groups hit by the segment from x1, y1 to x2, y2
+    // NOTE fraction is along the segment; normal is zero if the segment starts inside the collider
+    bool raycast(float x1, float y1, float x2, float y2, uint32_t groups, Actor*& hit, float& fraction, float& normX, float& normY);
     bool getEarliestCollision(const Actor* actor1, ActorIterator it, ActorIterator itEnd, Actor*& hit, float& start, float& end, float& normX, float& normY) const;
     bool getEarliestCollision(const Actor* actor1, Actor*& hit, float& start, float& end, float& normX, float& normY) const
         {return getEarliestCollision(actor1, m_actors.begin(), m_actors.end(), hit, start, end, normX, normY);}
@@ -65,13 +196,22 @@ private:
     static int canvas_addActor(lua_State* L);
     static int canvas_removeActor(lua_State* L);
     static int canvas_clear(lua_State* L);
+    static int canvas_addSystem(lua_State* L);
+    static int canvas_removeSystem(lua_State* L);
     static int canvas_getCamera(lua_State* L);
     static int canvas_setCamera(lua_State* L);
     static int canvas_setCenter(lua_State* L);
     static int canvas_setOrigin(lua_State* L);
     static int canvas_getCollision(lua_State* L);
+    static int canvas_queryPoint(lua_State* L);
+    static int canvas_queryRect(lua_State* L);
+    static int canvas_raycast(lua_State* L);
     static int canvas_setPaused(lua_State* L);
     static int canvas_setVisible(lua_State* L);
+    static int canvas_getGroupMask(lua_State* L);
+    static int canvas_setGroupMask(lua_State* L);
+    static int canvas_getCulledPairs(lua_State* L);
+    static int canvas_getCulledActors(lua_State* L);
 
     static constexpr const char* const CLASS_NAME = "Canvas";
     static constexpr const luaL_Reg METHODS[] =
@@ -79,11 +219,20 @@ private:
         {"addActor", canvas_addActor},
         {"removeActor", canvas_removeActor},
         {"clear", canvas_clear},
+        {"addSystem", canvas_addSystem},
+        {"removeSystem", canvas_removeSystem},
         {"setCenter", canvas_setCenter},
         {"setOrigin", canvas_setOrigin},
         {"getCollision", canvas_getCollision},
+        {"queryPoint", canvas_queryPoint},
+        {"queryRect", canvas_queryRect},
+        {"raycast", canvas_raycast},
         {"setPaused", canvas_setPaused},
         {"setVisible", canvas_setVisible},
+        {"getGroupMask", canvas_getGroupMask},
+        {"setGroupMask", canvas_setGroupMask},
+        {"getCulledPairs", canvas_getCulledPairs},
+        {"getCulledActors", canvas_getCulledActors},
         {nullptr, nullptr}
     };
 };
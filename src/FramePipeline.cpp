@@ -0,0 +1,57 @@
+#include "FramePipeline.hpp"
+
+#include <cassert>
+
+FramePipeline::FramePipeline()
+{
+    m_thread = std::thread(&FramePipeline::work, this);
+}
+
+FramePipeline::~FramePipeline()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_started.notify_one();
+
+    m_thread.join();
+}
+
+void FramePipeline::start(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        assert(!m_busy);
+        m_job = std::move(job);
+        m_busy = true;
+    }
+    m_started.notify_one();
+}
+
+void FramePipeline::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_finished.wait(lock, [this] {return !m_busy;});
+}
+
+void FramePipeline::work()
+{
+    for (;;)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_started.wait(lock, [this] {return m_quit || m_busy;});
+            if (m_quit && !m_busy)
+                return;
+            job = std::move(m_job);
+        }
+
+        job();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_busy = false;
+        m_finished.notify_one();
+    }
+}
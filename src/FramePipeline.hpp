@@ -0,0 +1,35 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Persistent thread running one job at a time, so the calling thread can work on the next frame meanwhile
+// NOTE start and wait must alternate; the job and the caller must not share state until wait returns
+class FramePipeline
+{
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_started;
+    std::condition_variable m_finished;
+    std::function<void()> m_job;
+    bool m_busy = false;
+    bool m_quit = false;
+
+public:
+    FramePipeline();
+    ~FramePipeline();
+
+    FramePipeline(const FramePipeline&) = delete;
+    FramePipeline& operator=(const FramePipeline&) = delete;
+
+    // Run job on the pipeline thread, returning immediately
+    void start(std::function<void()> job);
+
+    // Block until the last job started has finished
+    void wait();
+
+private:
+    void work();
+};
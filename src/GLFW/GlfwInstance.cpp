@@ -2,6 +2,8 @@
 #include "GlfwRenderer.hpp"
 #include "GlfwTexture.hpp"
 #include "Event.hpp"
+#include "FramePipeline.hpp"
+#include "RenderQueue.hpp"
 
 #include <cmath>
 #include <cstdio>
@@ -21,12 +23,21 @@ void GlfwInstance::run(const char* script)
     // The first event poll will take extra time; get it out of the way early
     instance.pollEvents();
 
+    if (instance.m_scene->isPipelined())
+    {
+        instance.runPipelined();
+        return;
+    }
+
     double lastTime = glfwGetTime();
     while (!instance.isQuit())
     {
         // Render first; returns right after vsync
         instance.render();
 
+        // Collect garbage in the time left before the next frame is due
+        instance.m_scene->collectGarbage();
+
         // We could improve the input latency by sleeping after vsync to push input/update closer to next vsync
 
         // Process event queue
@@ -154,6 +165,59 @@ bool GlfwInstance::init(const char* script)
     return true;
 }
 
+void GlfwInstance::runPipelined()
+{
+    GlfwRenderer* renderer = static_cast<GlfwRenderer*>(m_renderer.get());
+    FramePipeline pipeline;
+    RenderQueue queues[2];
+    int front = 0;
+
+    // Hand the context over to the render thread; events and the scene stay on this one
+    glfwMakeContextCurrent(nullptr);
+    pipeline.start([this] {glfwMakeContextCurrent(m_window);});
+    pipeline.wait();
+
+    double lastTime = glfwGetTime();
+    while (!isQuit())
+    {
+        // NOTE the framebuffer size may only be queried from this thread
+        int width, height;
+        glfwGetFramebufferSize(m_window, &width, &height);
+        renderer->setFramebufferSize(width, height);
+
+        // Draw the last frame recorded while updating and recording the next; returns right after vsync
+        const RenderQueue& queue = queues[front];
+        pipeline.start([renderer, &queue]
+        {
+            renderer->preRender();
+            queue.submit(renderer);
+            renderer->postRender();
+        });
+
+        pollEvents();
+
+        const double currentTime = glfwGetTime();
+        const double elapsedTime = currentTime - lastTime;
+        lastTime = currentTime;
+        update(elapsedTime);
+
+        RenderQueue& back = queues[1 - front];
+        m_scene->record(back);
+        back.detach();
+
+        // Collect garbage while the render thread waits for vsync
+        m_scene->collectGarbage();
+
+        pipeline.wait();
+        front = 1 - front;
+    }
+
+    // Take the context back, so resources can be released
+    pipeline.start([] {glfwMakeContextCurrent(nullptr);});
+    pipeline.wait();
+    glfwMakeContextCurrent(m_window);
+}
+
 void GlfwInstance::pollEvents()
 {
     // Try to process events first
@@ -170,11 +234,15 @@ void GlfwInstance::update(double elapsedTime)
         return;
 
     // Send elapsed time down to game objects
-    m_scene->update(elapsedTime);
+    m_scene->advance(float(elapsedTime));
 }
 
 void GlfwInstance::render()
 {
+    int width, height;
+    glfwGetFramebufferSize(m_window, &width, &height);
+    static_cast<GlfwRenderer*>(m_renderer.get())->setFramebufferSize(width, height);
+
     m_renderer->preRender();
     m_scene->render(m_renderer.get());
     m_renderer->postRender();
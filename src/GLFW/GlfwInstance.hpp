@@ -32,6 +32,7 @@ private:
     GlfwInstance(): m_window(nullptr) {}
 
     bool init(const char *script);
+    void runPipelined();
     void pollEvents();
     void update(double elapsedTime);
     void render();
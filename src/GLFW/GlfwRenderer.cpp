@@ -2,6 +2,7 @@
 #include "GlfwTexture.hpp"
 #include "TileMap.hpp"
 
+#include <algorithm>
 #include <iostream>
 
 bool GlfwRenderer::init()
@@ -25,7 +26,7 @@ bool GlfwRenderer::init()
     "layout(location = 1) in vec2 a_texCoord;\n"
     "out vec2 v_texCoord;\n"
     "void main() {\n"
-    "v_texCoord = (a_vertex * u_textureScale + u_textureOffset) * vec2(1, -1) + vec2(0, 1);\n"
+    "v_texCoord = (a_texCoord * u_textureScale + u_textureOffset) * vec2(1, -1) + vec2(0, 1);\n"
     "gl_Position = vec4((a_vertex * u_modelScale + u_modelOffset - u_cameraOffset) * vec2(2, -2) / u_cameraScale - vec2(1, -1), 0.0, 1.0);\n"
     "}\n";
 
@@ -39,40 +40,70 @@ bool GlfwRenderer::init()
     "f_color = vec4(u_color * texture(u_texture, v_texCoord).rgb, 1.0);\n"
     "}\n";
 
-    GLuint program = glCreateProgram();
-    glAttachShader(program, loadShader(vertexShader, GL_VERTEX_SHADER));
-    glAttachShader(program, loadShader(fragmentShader, GL_FRAGMENT_SHADER));
-    glLinkProgram(program);
-
-    GLint success;
-    glGetProgramiv(program, GL_LINK_STATUS, &success);
-
-    if (success == GL_FALSE)
-    {
-        // Get the length of the error log
-        GLint logLength = 0;
-        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+    // Tiles in view are drawn as one quad; each fragment looks up its tile, then the tile's texel in the tileset
+    // NOTE v_tile is in tiles from the map's top-left, and tiles are stored as their column and row in the tileset
+    const char* tileVertexShader =
+    "#version 410\n"
+    "uniform vec2 u_cameraScale;\n"
+    "uniform vec2 u_cameraOffset;\n"
+    "uniform vec2 u_modelScale;\n"
+    "uniform vec2 u_modelOffset;\n"
+    "uniform vec4 u_tileRect;\n"
+    "layout(location = 0) in vec2 a_vertex;\n"
+    "out vec2 v_tile;\n"
+    "void main() {\n"
+    "v_tile = u_tileRect.xy + a_vertex * u_tileRect.zw;\n"
+    "gl_Position = vec4((v_tile * u_modelScale + u_modelOffset - u_cameraOffset) * vec2(2, -2) / u_cameraScale - vec2(1, -1), 0.0, 1.0);\n"
+    "}\n";
 
-        // Get the error log and print
-        std::unique_ptr<char[]> errorLog(new char [logLength]);
-        glGetProgramInfoLog(program, logLength, &logLength, errorLog.get());
-        std::cerr << errorLog.get() << std::endl;
+    const char* tileFragmentShader =
+    "#version 410\n"
+    "uniform vec3 u_color;\n"
+    "uniform sampler2D u_texture;\n"
+    "uniform isampler2D u_tiles;\n"
+    "uniform sampler2D u_corners;\n"
+    "uniform vec2 u_tilesetSize;\n"
+    "uniform bool u_masked;\n"
+    "in vec2 v_tile;\n"
+    "out vec4 f_color;\n"
+    "void main() {\n"
+    "ivec2 cell = ivec2(v_tile);\n"
+    "ivec2 tile = texelFetch(u_tiles, cell, 0).rg;\n"
+    "if (tile.x < 0) discard;\n"
+    "vec2 texel = (vec2(tile) + v_tile - vec2(cell)) / u_tilesetSize;\n"
+    "float mask = u_masked ? texture(u_corners, (v_tile + 0.5) / vec2(textureSize(u_corners, 0))).r : 1.0;\n"
+    "f_color = vec4(u_color * mask * texture(u_texture, texel * vec2(1, -1) + vec2(0, 1)).rgb, 1.0);\n"
+    "}\n";
 
-        // Exit with failure
-        glDeleteProgram(program);
+    m_spriteProgram = loadProgram(vertexShader, fragmentShader);
+    m_tileProgram = loadProgram(tileVertexShader, tileFragmentShader);
+    if (!m_spriteProgram || !m_tileProgram)
         return false;
-    }
 
-    glUseProgram(program);
-
-    m_modelScale = glGetUniformLocation(program, "u_modelScale");
-    m_modelOffset = glGetUniformLocation(program, "u_modelOffset");
-    m_cameraScale = glGetUniformLocation(program, "u_cameraScale");
-    m_cameraOffset = glGetUniformLocation(program, "u_cameraOffset");
-    m_textureScale = glGetUniformLocation(program, "u_textureScale");
-    m_textureOffset = glGetUniformLocation(program, "u_textureOffset");
-    m_color = glGetUniformLocation(program, "u_color");
-    glUniform1i(glGetUniformLocation(program, "u_texture"), 0);
+    glUseProgram(m_tileProgram);
+
+    m_tileModelScale = glGetUniformLocation(m_tileProgram, "u_modelScale");
+    m_tileModelOffset = glGetUniformLocation(m_tileProgram, "u_modelOffset");
+    m_tileCameraScale = glGetUniformLocation(m_tileProgram, "u_cameraScale");
+    m_tileCameraOffset = glGetUniformLocation(m_tileProgram, "u_cameraOffset");
+    m_tileRect = glGetUniformLocation(m_tileProgram, "u_tileRect");
+    m_tilesetSize = glGetUniformLocation(m_tileProgram, "u_tilesetSize");
+    m_tileMasked = glGetUniformLocation(m_tileProgram, "u_masked");
+    m_tileColor = glGetUniformLocation(m_tileProgram, "u_color");
+    glUniform1i(glGetUniformLocation(m_tileProgram, "u_texture"), 0);
+    glUniform1i(glGetUniformLocation(m_tileProgram, "u_tiles"), 1);
+    glUniform1i(glGetUniformLocation(m_tileProgram, "u_corners"), 2);
+
+    glUseProgram(m_spriteProgram);
+
+    m_modelScale = glGetUniformLocation(m_spriteProgram, "u_modelScale");
+    m_modelOffset = glGetUniformLocation(m_spriteProgram, "u_modelOffset");
+    m_cameraScale = glGetUniformLocation(m_spriteProgram, "u_cameraScale");
+    m_cameraOffset = glGetUniformLocation(m_spriteProgram, "u_cameraOffset");
+    m_textureScale = glGetUniformLocation(m_spriteProgram, "u_textureScale");
+    m_textureOffset = glGetUniformLocation(m_spriteProgram, "u_textureOffset");
+    m_color = glGetUniformLocation(m_spriteProgram, "u_color");
+    glUniform1i(glGetUniformLocation(m_spriteProgram, "u_texture"), 0);
 
     // TODO: import some real mesh loading code
 
@@ -116,6 +147,35 @@ bool GlfwRenderer::init()
     return true;
 }
 
+GLuint GlfwRenderer::loadProgram(const char* vertexShader, const char* fragmentShader)
+{
+    GLuint program = glCreateProgram();
+    glAttachShader(program, loadShader(vertexShader, GL_VERTEX_SHADER));
+    glAttachShader(program, loadShader(fragmentShader, GL_FRAGMENT_SHADER));
+    glLinkProgram(program);
+
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+
+    if (success == GL_FALSE)
+    {
+        // Get the length of the error log
+        GLint logLength = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+
+        // Get the error log and print
+        std::unique_ptr<char[]> errorLog(new char [logLength]);
+        glGetProgramInfoLog(program, logLength, &logLength, errorLog.get());
+        std::cerr << errorLog.get() << std::endl;
+
+        // Exit with failure
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    return program;
+}
+
 GLuint GlfwRenderer::loadShader(const char* shaderCode, GLenum shaderType)
 {
     // Compile the shader file
@@ -148,9 +208,7 @@ GLuint GlfwRenderer::loadShader(const char* shaderCode, GLenum shaderType)
 
 void GlfwRenderer::preRender()
 {
-    int width, height;
-    glfwGetFramebufferSize(m_window, &width, &height);
-    glViewport(0, 0, width, height);
+    glViewport(0, 0, m_width, m_height);
     glClear(GL_COLOR_BUFFER_BIT);
 }
 
@@ -158,6 +216,20 @@ void GlfwRenderer::postRender()
 {
     // Update window and events
     glfwSwapBuffers(m_window);
+
+    // Release the textures of TileMaps that are no longer drawn
+    // NOTE textures are keyed by address, so a destroyed TileMap is only detected this way
+    ++m_frame;
+    for (auto it = m_tileTextures.begin(); it != m_tileTextures.end();)
+    {
+        if (m_frame - it->second.lastFrame > TileTextureFrames)
+        {
+            releaseTileTextures(it->second);
+            it = m_tileTextures.erase(it);
+        }
+        else
+            ++it;
+    }
 }
 
 void GlfwRenderer::pushModelTransform(Transform& transform)
@@ -169,26 +241,93 @@ void GlfwRenderer::pushModelTransform(Transform& transform)
 
 void GlfwRenderer::pushCameraTransform(Transform& transform)
 {
+    m_camera = transform;
     glUniform2f(m_cameraOffset, transform.getX(), transform.getY());
     glUniform2f(m_cameraScale, transform.getScaleX(), transform.getScaleY());
 }
 
 void GlfwRenderer::setColor(float red, float green, float blue)
 {
-    glUniform3f(m_color, red, green, blue);
+    m_colorValue[0] = red;
+    m_colorValue[1] = green;
+    m_colorValue[2] = blue;
+    glUniform3fv(m_color, 1, m_colorValue);
 }
 
-void GlfwRenderer::drawSprite(const std::string& name)
+GlfwTexture* GlfwRenderer::getTexture(const ResourceHandle& handle)
 {
-    // Get texture resource
-    GlfwTexturePtr texture = GlfwTexture::loadTexture(m_resources, name);
+    assert(handle.isValid());
+    if (handle.getIndex() >= int(m_textures.size()))
+        m_textures.resize(ResourceHandle::getCount(), nullptr);
+
+    // Load the texture resource the first time the handle is used
+    // NOTE the resource manager keeps the texture alive, so only the pointer is kept here
+    GlfwTexture*& texture = m_textures[handle.getIndex()];
     if (!texture)
+        texture = GlfwTexture::loadTexture(m_resources, handle.getName()).get();
+
+    return texture;
+}
+
+const GlfwRenderer::SpriteSource* GlfwRenderer::getSpriteSource(const ResourceHandle& handle)
+{
+    assert(handle.isValid());
+    if (handle.getIndex() >= int(m_spriteSources.size()))
+        m_spriteSources.resize(ResourceHandle::getCount());
+
+    SpriteSource& source = m_spriteSources[handle.getIndex()];
+    if (source.texture)
+        return &source;
+
+    // Pack small images into atlas pages, so sprites of different images share a texture
+    std::vector<char> data;
+    TextureAtlas::Image image;
+    TextureAtlas::Rect rect;
+    if (m_resources.loadRawData(handle.getName(), data) && TextureAtlas::decodeTGA(data, image) && m_atlas.pack(image.width, image.height, rect))
+    {
+        while (int(m_atlasPages.size()) <= rect.page)
+            m_atlasPages.push_back(GlfwTexture::createBlank(TextureAtlas::PageSize, TextureAtlas::PageSize));
+
+        // Copy the image along with its padding
+        // NOTE like other textures, pages are stored bottom row first, so the image is flipped and placed from the bottom
+        TextureAtlas::Image padded;
+        TextureAtlas::addPadding(image, padded);
+        TextureAtlas::flipRows(padded);
+        const int bottom = rect.y + rect.height + TextureAtlas::Padding;
+        m_atlasPages[rect.page]->update(rect.x - TextureAtlas::Padding, TextureAtlas::PageSize - bottom, padded.width, padded.height, padded.pixels.data());
+
+        const float size = float(TextureAtlas::PageSize);
+        source.texture = m_atlasPages[rect.page].get();
+        source.offsetX = rect.x / size;
+        source.offsetY = rect.y / size;
+        source.scaleX = rect.width / size;
+        source.scaleY = rect.height / size;
+    }
+    else
+    {
+        // Otherwise the image keeps a texture of its own
+        source.texture = getTexture(handle);
+        if (!source.texture)
+            return nullptr;
+
+        source.offsetX = source.offsetY = 0.f;
+        source.scaleX = source.scaleY = 1.f;
+    }
+
+    return &source;
+}
+
+void GlfwRenderer::drawSprite(const ResourceHandle& handle)
+{
+    // Get the texture and region holding the sprite
+    const SpriteSource* source = getSpriteSource(handle);
+    if (!source)
         return; // TODO: we should at least have a placeholder instead of null; assert here?
 
     // Bind the texture resource
-    texture->bind();
-    glUniform2f(m_textureOffset, 0.f, 0.f);
-    glUniform2f(m_textureScale, 1.f, 1.f);
+    source->texture->bind();
+    glUniform2f(m_textureOffset, source->offsetX, source->offsetY);
+    glUniform2f(m_textureScale, source->scaleX, source->scaleY);
 
     // Bind arrays and send draw command
     glBindVertexArray(m_spriteVAO);
@@ -204,55 +343,156 @@ void GlfwRenderer::drawTiles(const TileMap* tilemap)
         return;
 
     // Get texture resource
-    GlfwTexturePtr texture = GlfwTexture::loadTexture(m_resources, tileset->getFilename());
+    GlfwTexture* texture = getTexture(tileset->getTexture());
     if (!texture)
         return; // TODO: we should at least have a placeholder instead of null; assert here?
 
-    // Bind the texture and the sprite vao
+    // Only the tiles in view are covered by the quad
+    int left, top, right, bottom;
+    getVisibleTiles(m_model, m_camera, tilemap->getCols(), tilemap->getRows(), left, top, right, bottom);
+    if (left >= right || top >= bottom)
+        return;
+
+    TileTextures& textures = updateTileTextures(tilemap);
+
+    // Bind the tileset, tile indices and mask corners
     texture->bind();
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, textures.tiles);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, textures.corners);
+    glActiveTexture(GL_TEXTURE0);
+
+    glUseProgram(m_tileProgram);
+    glUniform2f(m_tileCameraOffset, m_camera.getX(), m_camera.getY());
+    glUniform2f(m_tileCameraScale, m_camera.getScaleX(), m_camera.getScaleY());
+    glUniform2f(m_tileModelOffset, m_model.getX(), m_model.getY());
+    glUniform2f(m_tileModelScale, m_model.getScaleX(), m_model.getScaleY());
+    glUniform4f(m_tileRect, float(left), float(top), float(right - left), float(bottom - top));
+    glUniform2f(m_tilesetSize, float(tileset->getCols()), float(tileset->getRows()));
+    glUniform1i(m_tileMasked, textures.corners != 0);
+    glUniform3fv(m_tileColor, 1, m_colorValue);
+
+    // Draw every tile in view at once
     glBindVertexArray(m_spriteVAO);
+    glDrawElements(GL_TRIANGLE_STRIP, 4, GL_UNSIGNED_INT, 0);
+    glBindVertexArray(0);
+
+    glUseProgram(m_spriteProgram);
+}
+
+GlfwRenderer::TileTextures& GlfwRenderer::updateTileTextures(const TileMap* tilemap)
+{
+    const TileSet* tileset = tilemap->getTileSet();
+    const TileMask* tileMask = tilemap->getTileMask();
+    const TileChunks& chunks = tilemap->getChunks();
+    const int cols = tilemap->getCols(), rows = tilemap->getRows();
+
+    // Start over if the map has been resized
+    // NOTE maps must fit in a texture, at least 16384 texels across in GL 4.1
+    TileTextures& textures = m_tileTextures[tilemap];
+    if (textures.cols != cols || textures.rows != rows)
+    {
+        releaseTileTextures(textures);
+        textures.cols = cols;
+        textures.rows = rows;
+        textures.stamps.assign(chunks.getCols() * chunks.getRows(), 0);
+        textures.maskStamps.assign(chunks.getCols() * chunks.getRows(), 0);
+
+        glGenTextures(1, &textures.tiles);
+        glBindTexture(GL_TEXTURE_2D, textures.tiles);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16I, cols, rows, 0, GL_RG_INTEGER, GL_SHORT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    }
 
-    // Compute and set texture size of one tile
-    const float tileW = 1.f / tileset->getCols();
-    const float tileH = 1.f / tileset->getRows();
-    glUniform2f(m_textureScale, tileW, tileH);
+    // Corners are only kept while the map has a mask
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (tileMask && !textures.corners)
+    {
+        // NOTE corners start dark, as those past the edge of a smaller mask are never uploaded
+        const std::vector<uint8_t> dark((cols + 1) * (rows + 1), 0);
+        glGenTextures(1, &textures.corners);
+        glBindTexture(GL_TEXTURE_2D, textures.corners);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, cols + 1, rows + 1, 0, GL_RED, GL_UNSIGNED_BYTE, dark.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    else if (!tileMask && textures.corners)
+    {
+        glDeleteTextures(1, &textures.corners);
+        textures.corners = 0;
+    }
 
-    // Compute and set model size of one tile
-    const float modelW = m_model.getScaleX();
-    const float modelH = m_model.getScaleY();
-    glUniform2f(m_modelScale, modelW, modelH);
+    textures.lastFrame = m_frame;
 
-    // TODO push all vertices and tex coords into mapped buffer -> single draw call
-    // Iterate over tile (x, y) indices
-    int i = 0;
-    for (int y = 0; y < tilemap->getRows(); ++y)
+    // Upload only the chunks whose tiles or mask have changed since they were last uploaded
+    // NOTE stamps are never reused, so this also catches a new TileMap at the address of a destroyed one
+    for (int cy = 0; cy < chunks.getRows(); ++cy)
     {
-        for (int x = 0; x < tilemap->getCols(); ++x)
+        for (int cx = 0; cx < chunks.getCols(); ++cx)
         {
-            // Skip if tile index invalid (blank tile)
-            const int tile = tilemap->getIndex(i++);
-            if (!tileset->isValidIndex(tile))
+            const uint32_t stamp = chunks.getStamp(cx, cy);
+            const uint32_t maskStamp = tileMask ? tileMask->getChunks().getStamp(cx, cy) : 0;
+            const int chunk = cy * chunks.getCols() + cx;
+            if (textures.stamps[chunk] == stamp && textures.maskStamps[chunk] == maskStamp)
                 continue;
 
-            // Index tiles from top-left
-            const float tileX = tileset->getIndexCol(tile) * tileW;
-            const float tileY = tileset->getIndexRow(tile) * tileH;
-            glUniform2f(m_textureOffset, tileX, tileY);
-
-            // Draw tilemap from top-left
-            const float modelX = m_model.getX() + x * modelW;
-            const float modelY = m_model.getY() + y * modelH;
-            glUniform2f(m_modelOffset, modelX, modelY);
-
-            // Draw the tile
-            glDrawElements(GL_TRIANGLE_STRIP, 4, GL_UNSIGNED_INT, 0);
+            const int left = cx * TileChunks::Size, right = std::min(left + TileChunks::Size, cols);
+            const int top = cy * TileChunks::Size, bottom = std::min(top + TileChunks::Size, rows);
+            const int pitch = right - left + 1;
+
+            // NOTE corners on the edges of a chunk are shared with its neighbours, so they are uploaded with both
+            if (tileMask)
+            {
+                tileMask->getCorners(left, top, right, bottom, m_corners);
+                glBindTexture(GL_TEXTURE_2D, textures.corners);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, left, top, pitch, bottom - top + 1, GL_RED, GL_UNSIGNED_BYTE, m_corners.data());
+            }
+
+            // Store the column and row of each tile in the tileset, so the shader only has to scale them
+            // NOTE blank tiles, and tiles that are dark at every corner, are stored as -1 and discarded
+            m_tileData.clear();
+            for (int y = top; y < bottom; ++y)
+            {
+                for (int x = left; x < right; ++x)
+                {
+                    const int tile = tilemap->getIndex(x, y);
+                    bool visible = tileset->isValidIndex(tile);
+                    if (visible && tileMask)
+                    {
+                        const uint8_t* corner = &m_corners[(y - top) * pitch + x - left];
+                        visible = corner[0] | corner[1] | corner[pitch] | corner[pitch + 1];
+                    }
+
+                    m_tileData.push_back(visible ? int16_t(tileset->getIndexCol(tile)) : -1);
+                    m_tileData.push_back(visible ? int16_t(tileset->getIndexRow(tile)) : -1);
+                }
+            }
+
+            glBindTexture(GL_TEXTURE_2D, textures.tiles);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, left, top, right - left, bottom - top, GL_RG_INTEGER, GL_SHORT, m_tileData.data());
+            textures.stamps[chunk] = stamp;
+            textures.maskStamps[chunk] = maskStamp;
         }
     }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-    glBindVertexArray(0);
+    return textures;
+}
+
+void GlfwRenderer::releaseTileTextures(TileTextures& textures)
+{
+    if (textures.tiles)
+        glDeleteTextures(1, &textures.tiles);
+    if (textures.corners)
+        glDeleteTextures(1, &textures.corners);
+    textures.tiles = textures.corners = 0;
 }
 
-void GlfwRenderer::drawLines(const std::vector<float>& points)
+void GlfwRenderer::drawLines(const float* points, size_t count)
 {
     // TODO
 }
@@ -2,17 +2,58 @@
 
 #include "IRenderer.hpp"
 #include "ResourceManager.hpp"
+#include "TextureAtlas.hpp"
 
 #include <vector>
+#include <unordered_map>
+#include <cstdint>
 
 #define GLFW_INCLUDE_GLCOREARB
 #include "GLFW/glfw3.h"
 
+class GlfwTexture;
+typedef std::shared_ptr<GlfwTexture> GlfwTexturePtr;
+
 class GlfwRenderer : public IRenderer
 {
+    // Region of a texture holding a sprite's image; either a whole texture or part of an atlas page
+    // NOTE offset and scale are in texture coordinates from the top-left, as expected by the shader
+    struct SpriteSource
+    {
+        GlfwTexture* texture = nullptr;
+        float offsetX, offsetY;
+        float scaleX, scaleY;
+    };
+
+    // Textures holding a TileMap's tile indices and TileMask corners, sampled by the tile shader
+    // NOTE chunks are uploaded again only when their TileChunks stamps change
+    struct TileTextures
+    {
+        GLuint tiles = 0; // column and row of each tile in the tileset, as integers
+        GLuint corners = 0; // TileMask values at tile corners, filtered to shade smoothly across tiles
+        int cols = 0, rows = 0; // in tiles
+        std::vector<uint32_t> stamps, maskStamps; // TileChunks stamps when last uploaded
+        int lastFrame = 0;
+    };
+
+    static constexpr const int TileTextureFrames = 60; // frames before the textures of an undrawn TileMap are released
+
     GLFWwindow* m_window;
     ResourceManager& m_resources;
+    int m_width = 0, m_height = 0; // framebuffer size, set by the instance
     Transform m_model;
+    Transform m_camera;
+    std::vector<GlfwTexture*> m_textures; // indexed by ResourceHandle; owned by m_resources
+    std::vector<SpriteSource> m_spriteSources; // indexed by ResourceHandle
+    std::vector<GlfwTexturePtr> m_atlasPages;
+    TextureAtlas m_atlas;
+    std::unordered_map<const TileMap*, TileTextures> m_tileTextures;
+    std::vector<int16_t> m_tileData; // scratch tileset columns and rows of the tiles of a chunk
+    std::vector<uint8_t> m_corners; // scratch TileMask values at tile corners
+    GLfloat m_colorValue[3] = {1.f, 1.f, 1.f}; // set for sprites, and for tiles when they are drawn
+    int m_frame = 0;
+    GLuint m_spriteProgram;
+    GLuint m_tileProgram;
     GLuint m_spriteVAO;
     GLint m_modelScale;
     GLint m_modelOffset;
@@ -21,6 +62,14 @@ class GlfwRenderer : public IRenderer
     GLint m_textureScale;
     GLint m_textureOffset;
     GLint m_color;
+    GLint m_tileCameraScale;
+    GLint m_tileCameraOffset;
+    GLint m_tileModelScale;
+    GLint m_tileModelOffset;
+    GLint m_tileRect;
+    GLint m_tilesetSize;
+    GLint m_tileMasked;
+    GLint m_tileColor;
     //std::vector<Matrix4> m_modelStack;
     //std::vector<Matrix4> m_viewStack;
 
@@ -30,20 +79,29 @@ public:
 
     bool init();
 
+    // NOTE glfwGetFramebufferSize must be called on the main thread, which may not be the one rendering
+    void setFramebufferSize(int width, int height) {m_width = width; m_height = height;}
+
     void preRender() override;
     void postRender() override;
 
     void pushModelTransform(Transform& transform) override;
     void pushCameraTransform(Transform& transform) override;
 
+    void setLayer(int /*layer*/) override {}
     void setColor(float red, float green, float blue) override;
-    void drawSprite(const std::string& name) override;
+    void drawSprite(const ResourceHandle& handle) override;
     void drawTiles(const TileMap* tilemap) override;
-    void drawLines(const std::vector<float>& points) override;
+    void drawLines(const float* points, size_t count) override;
 
     void popModelTransform() override;
     void popCameraTransform() override;
 
 private:
+    GlfwTexture* getTexture(const ResourceHandle& handle);
+    TileTextures& updateTileTextures(const TileMap* tilemap);
+    static void releaseTileTextures(TileTextures& textures);
+    const SpriteSource* getSpriteSource(const ResourceHandle& handle);
+    GLuint loadProgram(const char* vertexShader, const char* fragmentShader);
     GLuint loadShader(const char* shaderCode, GLenum shaderType);
 };
@@ -42,6 +42,19 @@ GlfwTexturePtr GlfwTexture::loadTexture(ResourceManager& manager, std::string fi
     return texture;
 }
 
+GlfwTexturePtr GlfwTexture::createBlank(GLsizei width, GLsizei height)
+{
+    std::vector<uint8_t> pixels(width * height * 4, 0);
+    GLuint texture = createTexture(width, height, pixels.data(), GL_RGBA, GL_RGBA, GL_UNSIGNED_BYTE, false);
+    return GlfwTexturePtr(new GlfwTexture(texture));
+}
+
+void GlfwTexture::update(GLint x, GLint y, GLsizei width, GLsizei height, const GLvoid* pixels)
+{
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+}
+
 GLuint GlfwTexture::createTexture(GLsizei width, GLsizei height, const GLvoid* data, GLenum channels, GLenum order, GLenum format, bool useMipmap)
 {
     GLuint texture;
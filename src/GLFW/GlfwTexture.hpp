@@ -25,6 +25,10 @@ public:
 
     static GlfwTexturePtr loadTexture(ResourceManager& manager, std::string filename);
 
+    // Create a black RGBA texture, to be filled a region at a time
+    static GlfwTexturePtr createBlank(GLsizei width, GLsizei height);
+    void update(GLint x, GLint y, GLsizei width, GLsizei height, const GLvoid* pixels); // NOTE 32 bit RGBA pixels
+
 // TODO: check access rights on these functions
 protected:
     static GLuint createTexture(GLsizei width, GLsizei height, const GLvoid* data, GLenum channels, GLenum order, GLenum format, bool useMipmap);
@@ -2,6 +2,7 @@
 
 #include "IUserdata.hpp"
 #include "Event.hpp"
+#include "Aabb.hpp"
 
 class Canvas;
 class IRenderer;
@@ -31,6 +32,9 @@ public:
 
     virtual void mouseToWorld(const MouseEvent& event, float& x, float& y) const = 0;
 
+    // Get the region of the world in view, for culling
+    virtual Aabb getBounds() const = 0;
+
 private:
     friend class TUserdata<ICamera>;
     //void construct(lua_State* L);
@@ -1,4 +1,6 @@
 #include "ICollider.hpp"
+#include "Actor.hpp"
+#include "Canvas.hpp"
 #include "Serializer.hpp"
 
 const luaL_Reg ICollider::METHODS[];
@@ -31,6 +33,61 @@ int ICollider::script_setCollidable(lua_State* L)
     luaL_checktype(L, 2, LUA_TBOOLEAN);
 
     self->setCollidable(lua_toboolean(L, 2) == 1);
+    if (self->m_actor)
+        self->m_actor->touch();
+
+    return 0;
+}
+
+int ICollider::script_getGroup(lua_State* L)
+{
+    // Validate function arguments
+    ICollider* self = ICollider::checkInterface(L, 1);
+
+    lua_pushinteger(L, self->m_colliderGroup);
+    return 1;
+}
+
+int ICollider::script_setGroup(lua_State* L)
+{
+    // Validate function arguments
+    ICollider* self = ICollider::checkInterface(L, 1);
+    uint32_t group = uint32_t(luaL_checkinteger(L, 2));
+
+    // NOTE Canvas buckets colliders by group
+    self->setGroup(group);
+    if (self->m_actor)
+    {
+        if (self->m_actor->m_canvas)
+            self->m_actor->m_canvas->invalidateColliders();
+        self->m_actor->touch();
+    }
+
+    return 0;
+}
+
+int ICollider::script_getMask(lua_State* L)
+{
+    // Validate function arguments
+    ICollider* self = ICollider::checkInterface(L, 1);
+
+    lua_pushinteger(L, self->m_colliderMask);
+    return 1;
+}
+
+int ICollider::script_setMask(lua_State* L)
+{
+    // Validate function arguments
+    ICollider* self = ICollider::checkInterface(L, 1);
+    uint32_t mask = uint32_t(luaL_checkinteger(L, 2));
+
+    self->setMask(mask);
+    if (self->m_actor)
+    {
+        if (self->m_actor->m_canvas)
+            self->m_actor->m_canvas->invalidateColliders();
+        self->m_actor->touch();
+    }
 
     return 0;
 }
@@ -31,8 +31,9 @@ public:
     virtual bool testCollision(const Aabb& aabb) const = 0;
     virtual bool testCollision(float deltaX, float deltaY, const ICollider* other) const = 0;
 
-    virtual bool getCollisionTime(const Aabb& aabb, float velX, float velY, float& start, float& end, float& normX, float& normY) const = 0;
-    virtual bool getCollisionTime(float velX, float velY, const ICollider* other, float& start, float& end, float& normX, float& normY) const = 0;
+    // NOTE collisions starting after horizon may be missed; colliders use it to stop searching early
+    virtual bool getCollisionTime(const Aabb& aabb, float velX, float velY, float horizon, float& start, float& end, float& normX, float& normY) const = 0;
+    virtual bool getCollisionTime(float velX, float velY, const ICollider* other, float horizon, float& start, float& end, float& normX, float& normY) const = 0;
 
     bool isCollidable() const {return m_collidable;}
     bool isCollidableWith(const ICollider* other) const {assert(other); return isCollidable() && other->isCollidable() && isMasked(other) && other->isMasked(this);}
@@ -40,6 +41,8 @@ public:
 
     void setGroup(uint32_t group) {m_colliderGroup = group;}
     void setMask(uint32_t mask) {m_colliderMask = mask;}
+    uint32_t getGroup() const {return m_colliderGroup;}
+    uint32_t getMask() const {return m_colliderMask;}
     bool isMasked(const ICollider* other) const {assert(other); return (m_colliderGroup & other->m_colliderMask) > 0;}
 
 private:
@@ -50,11 +53,19 @@ private:
     void serialize(lua_State* L, Serializer* serializer, ObjectRef* ref);
 
     static int script_setCollidable(lua_State* L);
+    static int script_getGroup(lua_State* L);
+    static int script_setGroup(lua_State* L);
+    static int script_getMask(lua_State* L);
+    static int script_setMask(lua_State* L);
 
     static constexpr const char* const CLASS_NAME = "ICollider";
     static constexpr const luaL_Reg METHODS[] =
     {
         {"setCollidable", script_setCollidable},
+        {"getGroup", script_getGroup},
+        {"setGroup", script_setGroup},
+        {"getMask", script_getMask},
+        {"setMask", script_setMask},
         {nullptr, nullptr}
     };
 };
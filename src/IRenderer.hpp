@@ -1,9 +1,12 @@
 #pragma once
 
 #include "Transform.hpp"
+#include "ResourceHandle.hpp"
 
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <cmath>
 
 class TileMap;
 
@@ -18,11 +21,38 @@ public:
     virtual void pushModelTransform(Transform& transform) = 0;
     virtual void pushCameraTransform(Transform& transform) = 0;
 
+    // NOTE sprites within a layer may be drawn in any order by texture
+    virtual void setLayer(int layer) = 0;
     virtual void setColor(float red, float green, float blue) = 0;
-    virtual void drawSprite(const std::string& name) = 0;
+    virtual void drawSprite(const ResourceHandle& sprite) = 0;
     virtual void drawTiles(const TileMap* tilemap) = 0;
-    virtual void drawLines(const std::vector<float>& points) = 0;
+    // NOTE points hold runs of a segment count followed by that many x, y pairs
+    virtual void drawLines(const float* points, size_t count) = 0;
+    void drawLines(const std::vector<float>& points) {drawLines(points.data(), points.size());}
 
     virtual void popModelTransform() = 0;
     virtual void popCameraTransform() = 0;
+
+protected:
+    // Get the range of tiles in view of the camera, for a map whose model transform gives the size of one tile
+    // NOTE right and bottom are exclusive, and the range is empty if the map is out of view
+    static void getVisibleTiles(const Transform& model, const Transform& camera, int cols, int rows, int& left, int& top, int& right, int& bottom);
 };
+
+inline void IRenderer::getVisibleTiles(const Transform& model, const Transform& camera, int cols, int rows, int& left, int& top, int& right, int& bottom)
+{
+    const float tileW = model.getScaleX(), tileH = model.getScaleY();
+    if (tileW <= 0.f || tileH <= 0.f)
+    {
+        left = top = right = bottom = 0;
+        return;
+    }
+
+    // Clamp in float first, so a map far out of view can't overflow int
+    const float x = (camera.getX() - model.getX()) / tileW;
+    const float y = (camera.getY() - model.getY()) / tileH;
+    left = int(std::min(std::max(std::floor(x), 0.f), float(cols)));
+    top = int(std::min(std::max(std::floor(y), 0.f), float(rows)));
+    right = int(std::min(std::max(std::ceil(x + camera.getScaleX() / tileW), float(left)), float(cols)));
+    bottom = int(std::min(std::max(std::ceil(y + camera.getScaleY() / tileH), float(top)), float(rows)));
+}
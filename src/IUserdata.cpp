@@ -2,16 +2,23 @@
 #include "Serializer.hpp"
 #include "Scene.hpp"
 
-void IUserdata::pushUserdata(lua_State* L)
+#include <cstring>
+
+const char* const IUserdata::CALLBACK_NAMES[] =
 {
-    lua_pushstring(L, Scene::WEAK_REFS);
-    lua_rawget(L, LUA_REGISTRYINDEX);
-    assert(lua_type(L, -1) == LUA_TTABLE);
+    "onUpdate",
+    "onUpdatePre",
+    "onUpdatePost",
+    "onCollide",
+    "onClick",
+    "onClickPre",
+    "onClickPost"
+};
 
-    // NOTE IUserdata::this != base address; only use as lookup pointer
-    lua_pushlightuserdata(L, this);
-    lua_rawget(L, -2);
-    lua_remove(L, -2);
+void IUserdata::pushUserdata(lua_State* L)
+{
+    assert(m_ref != 0);
+    Scene::checkScene(L)->pushUserdataRef(L, m_ref);
 
     assert(testInterface(L, -1) == this); // upcast to IUserdata
 }
@@ -77,34 +84,31 @@ void IUserdata::releaseChild(lua_State* L, void* ptr)
     lua_pop(L, 1);
 }
 
-bool IUserdata::pcall(lua_State* L, const char* method, int in, int out)
+bool IUserdata::pcall(lua_State* L, Callback callback, int in, int out)
 {
-    pushUserdata(L);
-
-    // Push uservalue on stack ([in] udata uvalue)
-    if (lua_getuservalue(L, -1) != LUA_TTABLE)
+    // NOTE this is not an error so don't spam error messages about it!
+    if (!hasCallback(callback))
     {
-        // NOTE this is not an error so don't spam error messages about it!
-        lua_pop(L, in + 2);
+        lua_pop(L, in);
         return false;
     }
 
-    // Push function on stack ([in] udata uvalue function)
-    lua_pushstring(L, method); // TODO this is unsafe if it fails (out of memory error)
-    if (lua_rawget(L, -2) != LUA_TFUNCTION)
-    {
-        // NOTE this is not an error so don't spam error messages about it!
-        lua_pop(L, in + 3);
-        return false;
-    }
+    pushUserdata(L);
+
+    // Push function on stack ([in] udata function)
+    // NOTE the name is an interned string held by the Scene, so it isn't hashed again
+    Scene* scene = Scene::checkScene(L);
+    lua_getuservalue(L, -1);
+    scene->pushCallbackName(L, callback);
+    lua_rawget(L, -2);
+    lua_remove(L, -2);
+    assert(lua_type(L, -1) == LUA_TFUNCTION);
 
     // Reorder stack (function udata [in])
-    lua_insert(L, -(in + 3)); // insert function before args
-    lua_pop(L, 1); // remove the uservalue from the stack
+    lua_insert(L, -(in + 2)); // insert function before args
     lua_insert(L, -(in + 1)); // insert udata before args
 
     // Set 30 ms watchdog to protect against malformed or excessively slow code
-    Scene* scene = Scene::checkScene(L);
     scene->setWatchdog(30);
 
     // Do a protected call; pops function, udata, and args
@@ -121,6 +125,35 @@ bool IUserdata::pcall(lua_State* L, const char* method, int in, int out)
     return true;
 }
 
+void IUserdata::updateCallback(lua_State* L, int key, int value)
+{
+    // Only string keys starting with "on" can name callbacks; tags are noted for Canvas systems
+    if (lua_type(L, key) != LUA_TSTRING)
+        return;
+
+    const char* name = lua_tostring(L, key);
+    if (strcmp(name, "tag") == 0)
+    {
+        Scene::checkScene(L)->touchTags();
+        return;
+    }
+
+    if (name[0] != 'o' || name[1] != 'n')
+        return;
+
+    for (int i = 0; i < CallbackCount; ++i)
+    {
+        if (strcmp(name, CALLBACK_NAMES[i]) == 0)
+        {
+            if (lua_type(L, value) == LUA_TFUNCTION)
+                m_callbacks |= 1u << i;
+            else
+                m_callbacks &= ~(1u << i);
+            return;
+        }
+    }
+}
+
 void IUserdata::initInterface(lua_State* L)
 {
     //setMethods(L, METHODS);//T::METHODS);
@@ -136,20 +169,7 @@ void IUserdata::initInterface(lua_State* L)
     lua_rawset(L, -3);
 }
 
-static inline void add_weak_ref(lua_State* L, IUserdata* ptr)
-{
-    // Add weak ref to userdata lookup table
-    lua_pushstring(L, Scene::WEAK_REFS);
-    lua_rawget(L, LUA_REGISTRYINDEX);
-    assert(lua_type(L, -1) == LUA_TTABLE);
-    // NOTE IUserdata::this != base address; only use as lookup pointer
-    lua_pushlightuserdata(L, ptr);
-    lua_pushvalue(L, -3); // the userdata
-    lua_rawset(L, -3);
-    lua_pop(L, 1);
-}
-
-static inline void copy_uservalues(lua_State* L)
+void IUserdata::copyUservalues(lua_State* L, IUserdata* ptr)
 {
     // Create a new table for shallow copy
     lua_newtable(L);
@@ -158,6 +178,8 @@ static inline void copy_uservalues(lua_State* L)
     lua_pushnil(L);
     while (lua_next(L, -3))
     {
+        ptr->updateCallback(L, -2, -1);
+
         // Duplicate key, set key/value, leave key on stack for next iteration of lua_next
         lua_pushvalue(L, -2);
         lua_insert(L, -2);
@@ -172,32 +194,38 @@ static inline void copy_uservalues(lua_State* L)
 
 void IUserdata::constructHelper(lua_State* L, IUserdata* ptr, int index)
 {
-    add_weak_ref(L, ptr);
+    // NOTE the userdata is on top of the stack
+    ptr->m_ref = Scene::checkScene(L)->acquireUserdataRef(L, -1);
 
     // Copy the member table if specified
     lua_pushliteral(L, "members");
     if (lua_rawget(L, index) != LUA_TNIL)
     {
         luaL_checktype(L, -1, LUA_TTABLE);
-        copy_uservalues(L);
+        copyUservalues(L, ptr);
     }
     lua_pop(L, 1);
 }
 
 void IUserdata::cloneHelper(lua_State* L, IUserdata* ptr, IUserdata* /*source*/, int index)
 {
-    add_weak_ref(L, ptr);
+    // NOTE the userdata is on top of the stack
+    ptr->m_ref = Scene::checkScene(L)->acquireUserdataRef(L, -1);
 
     if (lua_getuservalue(L, index) != LUA_TNIL)
     {
         assert(lua_type(L, -1) == LUA_TTABLE);
-        copy_uservalues(L);
+        copyUservalues(L, ptr);
     }
     lua_pop(L, 1);
 }
 
 void IUserdata::destroyHelper(lua_State* L, IUserdata* ptr)
 {
+    // Free the userdata's slot for reuse
+    if (ptr->m_ref != 0)
+        Scene::checkScene(L)->releaseUserdataRef(L, ptr->m_ref);
+
     // Delete child ref table
     lua_pushlightuserdata(L, ptr);
     lua_pushnil(L);
@@ -259,5 +287,9 @@ int IUserdata::script_newindex(lua_State* L)
     lua_pushvalue(L, 3);
     lua_rawset(L, -3);
 
+    // Track whether a callback was set or cleared
+    IUserdata* ptr = testInterface(L, 1);
+    ptr->updateCallback(L, 2, 3);
+
     return 0;
 }
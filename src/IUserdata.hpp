@@ -4,6 +4,7 @@
 #include <cassert>
 #include <string>
 #include <vector>
+#include <cstdint>
 #include "lua.h"
 #include "lauxlib.h"
 // TODO limit to lua_State* in this file so we can remove header
@@ -17,9 +18,31 @@ class IUserdata
 protected:
     static constexpr const char* const CLASS_NAME = "IUserdata";
 
+public:
+    // Members called by the engine when scripts set them to functions
+    enum Callback
+    {
+        OnUpdate,
+        OnUpdatePre,
+        OnUpdatePost,
+        OnCollide,
+        OnClick,
+        OnClickPre,
+        OnClickPost,
+        CallbackCount
+    };
+
+private:
+    static const char* const CALLBACK_NAMES[CallbackCount];
+    uint32_t m_callbacks = 0; // bit per Callback set to a function in the uservalue table; kept up to date as it is written
+    int m_ref = 0; // slot holding this object's userdata in the Scene's weak table, so it can be pushed without a lookup
+
 public:
     virtual ~IUserdata() {}
 
+    static const char* getCallbackName(int callback) {return CALLBACK_NAMES[callback];}
+    bool hasCallback(Callback callback) const {return m_callbacks & (1u << callback);}
+
     void pushUserdata(lua_State* L);
     void pushClone(lua_State* L);
 
@@ -238,15 +261,16 @@ protected:
         }
     }
 
-    bool pcall(lua_State* L, const char* method, int in, int out);
+    // NOTE arguments are popped without a call if the callback isn't set
+    bool pcall(lua_State* L, Callback callback, int in, int out);
 
     template <class T> static void pushT(lua_State* L, T arg);
     template <class T> static void popT(lua_State* L, T& arg, int i);
 
     template <int N=0, class R>
-    R pcallT(lua_State* L, const char* method, R ret)
+    R pcallT(lua_State* L, Callback callback, R ret)
     {
-        if (pcall(L, method, N, 1))
+        if (pcall(L, callback, N, 1))
         {
             popT(L, ret, -1);
             lua_pop(L, 1);
@@ -256,10 +280,14 @@ protected:
     }
 
     template <int N=0, class R, class A, class ...As>
-    R pcallT(lua_State* L, const char* method, R ret, A arg, As ...args)
+    R pcallT(lua_State* L, Callback callback, R ret, A arg, As ...args)
     {
+        // Skip pushing arguments for callbacks that aren't set
+        if (N == 0 && !hasCallback(callback))
+            return ret;
+
         pushT(L, arg);
-        return pcallT<N+1>(L, method, ret, args...);
+        return pcallT<N+1>(L, callback, ret, args...);
     }
 
 private:
@@ -271,6 +299,9 @@ private:
     static void serializeHelper(lua_State* L, IUserdata* ptr, Serializer* serializer, ObjectRef* ref);
 
 private:
+    void updateCallback(lua_State* L, int key, int value);
+    static void copyUservalues(lua_State* L, IUserdata* ptr);
+
     static int script_index(lua_State* L);
     static int script_newindex(lua_State* L);
 };
@@ -0,0 +1,322 @@
+#include "PhysicsPool.hpp"
+#include "Physics.hpp"
+#include "Actor.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+// NOTE define to compare against the plain loop; vector and scalar paths give identical results without FMA contraction
+//#define PHYSICS_SCALAR
+#if !defined(PHYSICS_SCALAR) && defined(__AVX__)
+#define PHYSICS_AVX
+#include <immintrin.h>
+#elif !defined(PHYSICS_SCALAR) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define PHYSICS_SSE
+#include <xmmintrin.h>
+#endif
+
+void PhysicsPool::attach(Actor* actor)
+{
+    assert(actor->m_physics);
+    if (actor->m_pool == this)
+        return;
+
+    // Take the Actor from any other Canvas it is still simulated by
+    if (actor->m_pool)
+        actor->m_pool->detach(actor);
+
+    const Physics& physics = *actor->m_physics;
+    actor->m_pool = this;
+    actor->m_body = getCount();
+
+    m_actors.push_back(actor);
+    m_posX.push_back(actor->m_transform.getX());
+    m_posY.push_back(actor->m_transform.getY());
+    m_prevX.push_back(actor->m_transform.getX());
+    m_prevY.push_back(actor->m_transform.getY());
+    m_velX.push_back(physics.m_vel.x);
+    m_velY.push_back(physics.m_vel.y);
+    m_accX.push_back(physics.m_acc.x);
+    m_accY.push_back(physics.m_acc.y);
+    m_mass.push_back(physics.m_mass);
+    m_cor.push_back(physics.m_cor);
+    m_cof.push_back(physics.m_cof);
+    m_collisions.push_back(0);
+    m_stuck.push_back(0);
+    m_restFrames.push_back(0);
+    m_asleep.push_back(0);
+}
+
+void PhysicsPool::detach(Actor* actor)
+{
+    assert(actor->m_pool == this);
+    const int body = actor->m_body;
+
+    // Hand state back to the Actor
+    load(body, *actor->m_physics);
+    actor->m_transform.setPosition(m_posX[body], m_posY[body]);
+    actor->m_pool = nullptr;
+    actor->m_body = -1;
+
+    // Fill the gap with the last body
+    const int last = getCount() - 1;
+    if (body != last)
+    {
+        m_actors[body] = m_actors[last];
+        m_actors[body]->m_body = body;
+        m_posX[body] = m_posX[last];
+        m_posY[body] = m_posY[last];
+        m_prevX[body] = m_prevX[last];
+        m_prevY[body] = m_prevY[last];
+        m_velX[body] = m_velX[last];
+        m_velY[body] = m_velY[last];
+        m_accX[body] = m_accX[last];
+        m_accY[body] = m_accY[last];
+        m_mass[body] = m_mass[last];
+        m_cor[body] = m_cor[last];
+        m_cof[body] = m_cof[last];
+        m_collisions[body] = m_collisions[last];
+        m_stuck[body] = m_stuck[last];
+        m_restFrames[body] = m_restFrames[last];
+        m_asleep[body] = m_asleep[last];
+    }
+
+    m_actors.pop_back();
+    m_posX.pop_back();
+    m_posY.pop_back();
+    m_prevX.pop_back();
+    m_prevY.pop_back();
+    m_velX.pop_back();
+    m_velY.pop_back();
+    m_accX.pop_back();
+    m_accY.pop_back();
+    m_mass.pop_back();
+    m_cor.pop_back();
+    m_cof.pop_back();
+    m_collisions.pop_back();
+    m_stuck.pop_back();
+    m_restFrames.pop_back();
+    m_asleep.pop_back();
+}
+
+void PhysicsPool::detachAll()
+{
+    while (!m_actors.empty())
+        detach(m_actors.back());
+}
+
+void PhysicsPool::load(int body, Physics& physics) const
+{
+    physics.m_vel.x = m_velX[body];
+    physics.m_vel.y = m_velY[body];
+    physics.m_acc.x = m_accX[body];
+    physics.m_acc.y = m_accY[body];
+    physics.m_mass = m_mass[body];
+    physics.m_cor = m_cor[body];
+    physics.m_cof = m_cof[body];
+}
+
+void PhysicsPool::savePositions()
+{
+    m_prevX = m_posX;
+    m_prevY = m_posY;
+}
+
+float PhysicsPool::getMaxStep() const
+{
+    float step = 0.f;
+    for (size_t i = 0; i < m_posX.size(); ++i)
+        step = std::max(step, std::max(std::abs(m_posX[i] - m_prevX[i]), std::abs(m_posY[i] - m_prevY[i])));
+    return step;
+}
+
+void PhysicsPool::preUpdate(float delta)
+{
+    // Apply acceleration to velocity at start of frame
+    const int count = getCount();
+    for (int i = 0; i < count; ++i)
+    {
+        m_velX[i] += m_accX[i] * delta;
+        m_velY[i] += m_accY[i] * delta;
+    }
+
+    std::fill(m_accX.begin(), m_accX.end(), 0.f);
+    std::fill(m_accY.begin(), m_accY.end(), 0.f);
+    std::fill(m_collisions.begin(), m_collisions.end(), 0);
+    std::fill(m_stuck.begin(), m_stuck.end(), 0);
+}
+
+void PhysicsPool::advance(float delta)
+{
+    const int count = getCount();
+    float* const posX = m_posX.data();
+    float* const posY = m_posY.data();
+    const float* const velX = m_velX.data();
+    const float* const velY = m_velY.data();
+
+    int i = 0;
+#if defined(PHYSICS_AVX)
+    const __m256 step = _mm256_set1_ps(delta);
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm256_storeu_ps(posX + i, _mm256_add_ps(_mm256_loadu_ps(posX + i), _mm256_mul_ps(_mm256_loadu_ps(velX + i), step)));
+        _mm256_storeu_ps(posY + i, _mm256_add_ps(_mm256_loadu_ps(posY + i), _mm256_mul_ps(_mm256_loadu_ps(velY + i), step)));
+    }
+#elif defined(PHYSICS_SSE)
+    const __m128 step = _mm_set1_ps(delta);
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_ps(posX + i, _mm_add_ps(_mm_loadu_ps(posX + i), _mm_mul_ps(_mm_loadu_ps(velX + i), step)));
+        _mm_storeu_ps(posY + i, _mm_add_ps(_mm_loadu_ps(posY + i), _mm_mul_ps(_mm_loadu_ps(velY + i), step)));
+    }
+#endif
+
+    // Remainder, or everything when not vectorized
+    for (; i < count; ++i)
+    {
+        posX[i] += velX[i] * delta;
+        posY[i] += velY[i] * delta;
+    }
+}
+
+bool PhysicsPool::updateSleep(float maxVel, int frames)
+{
+    const float maxVelSq = maxVel * maxVel;
+    bool slept = false;
+
+    const int count = getCount();
+    for (int i = 0; i < count; ++i)
+    {
+        if (m_asleep[i])
+            continue;
+
+        if (m_velX[i] * m_velX[i] + m_velY[i] * m_velY[i] >= maxVelSq)
+        {
+            m_restFrames[i] = 0;
+            continue;
+        }
+
+        if (++m_restFrames[i] < frames)
+            continue;
+
+        m_velX[i] = 0.f;
+        m_velY[i] = 0.f;
+        m_asleep[i] = true;
+        slept = true;
+    }
+
+    return slept;
+}
+
+bool PhysicsPool::wake(int body)
+{
+    m_restFrames[body] = 0;
+    if (!m_asleep[body])
+        return false;
+
+    m_asleep[body] = false;
+    return true;
+}
+
+// NOTE other is -1 when colliding with an Actor without physics
+void PhysicsPool::collide(int body, int other, float normX, float normY)
+{
+    assert(body >= 0 && body < getCount());
+    assert(other < getCount());
+    const bool hasOther = other >= 0;
+
+    // TODO might be more effective to apply motion constraints when we hit static objects
+    if (m_collisions[body] >= 4 && (!hasOther || m_collisions[other] >= 4))// || m_stuck[other]))
+    {
+        m_stuck[body] = true;
+        //m_velX[body] = 0.f;
+        //m_velY[body] = 0.f;
+        // NOTE this might only get applied to the first object
+        const float dot = m_velX[body] * normX + m_velY[body] * normY;
+        m_velX[body] -= normX * dot;
+        m_velY[body] -= normY * dot;
+    }
+    ++m_collisions[body];
+
+    if (m_stuck[body])
+    {
+        if (hasOther && !m_stuck[other])
+            collide(other, body, normX, normY);
+        return;
+    }
+
+    float relVelX = m_velX[body];
+    float relVelY = m_velY[body];
+
+    float cor = m_cor[body];
+    float cof = m_cof[body];
+    if (hasOther)
+    {
+        // Get velocity of obj1 in the frame of ref of obj2
+        relVelX -= m_velX[other];
+        relVelY -= m_velY[other];
+
+        cor *= m_cor[other];
+        cof *= m_cof[other];
+
+        ++m_collisions[other];
+    }
+    // HACK remove COR when colliding infinite mass with static
+    else if (std::isinf(m_mass[body]))
+    {
+        cor = 0.f;
+    }
+
+    // Get the component of velocity in the normal direction
+    const float dot = relVelX * normX + relVelY * normY;
+    const float normVelX = normX * dot;
+    const float normVelY = normY * dot;
+
+    // Apply restitution coefficient to get rebound velocity
+    const float restitutionX = normVelX * (1 + cor);
+    const float restitutionY = normVelY * (1 + cor);
+
+    if (hasOther && !m_stuck[other])
+    {
+        // TODO handle infinite mass explicitly
+        const float m1 = m_mass[body];
+        const float m2 = m_mass[other];
+        float ratio1, ratio2;
+        if (std::isinf(m1))
+        {
+            if (std::isinf(m2))
+            {
+                ratio1 = 0.5f;
+                ratio2 = 0.5f;
+            }
+            else
+            {
+                ratio1 = 0.f;
+                ratio2 = 1.f;
+            }
+        }
+        else if (std::isinf(m2))
+        {
+            ratio1 = 1.f;
+            ratio2 = 0.f;
+        }
+        else
+        {
+            ratio1 = m2 / (m1 + m2);
+            ratio2 = m1 / (m1 + m2);
+        }
+
+        // Subtract a fraction of the collision velocity from obj1, and add it to obj2
+        m_velX[body] -= restitutionX * ratio1;
+        m_velY[body] -= restitutionY * ratio1;
+        m_velX[other] += restitutionX * ratio2;
+        m_velY[other] += restitutionY * ratio2;
+    }
+    else
+    {
+        // Subtract the collision velocity from obj1
+        // Use no friction with static objects for now...
+        m_velX[body] -= restitutionX;
+        m_velY[body] -= restitutionY;
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cassert>
+
+class Actor;
+class Physics;
+
+// Physics state of all Actors in a Canvas, stored as parallel arrays so each step runs over contiguous memory
+// NOTE Actors keep their index into the pool; positions here take precedence over the Actor's Transform
+class PhysicsPool
+{
+    std::vector<Actor*> m_actors;
+    std::vector<float> m_posX, m_posY;
+    std::vector<float> m_prevX, m_prevY; // positions at the start of the last step, for interpolating between steps
+    std::vector<float> m_velX, m_velY;
+    std::vector<float> m_accX, m_accY;
+    std::vector<float> m_mass;
+    std::vector<float> m_cor;
+    std::vector<float> m_cof;
+    std::vector<uint8_t> m_collisions;
+    std::vector<uint8_t> m_stuck;
+    std::vector<uint16_t> m_restFrames; // consecutive frames spent below the sleep velocity
+    std::vector<uint8_t> m_asleep;
+
+public:
+    PhysicsPool() = default;
+    ~PhysicsPool() {}
+
+    int getCount() const {return int(m_actors.size());}
+    Actor* getActor(int body) const {return m_actors[body];}
+
+    // Move an Actor's physics state and position into the pool, or back out again
+    void attach(Actor* actor);
+    void detach(Actor* actor);
+    void detachAll();
+
+    void savePositions();
+    void preUpdate(float delta);
+    void advance(float delta);
+    void collide(int body, int other, float normX, float normY);
+
+    // Put bodies to sleep once they have stayed slower than maxVel for the given number of frames; returns true if any did
+    // NOTE sleeping bodies have zero velocity, so Canvas can treat them as static until woken
+    bool updateSleep(float maxVel, int frames);
+    bool isAsleep(int body) const {return m_asleep[body] != 0;}
+    bool wake(int body); // returns true if the body was asleep
+
+    float getPosX(int body) const {return m_posX[body];}
+    float getPosY(int body) const {return m_posY[body];}
+    void setPosition(int body, float x, float y) {m_posX[body] = m_prevX[body] = x; m_posY[body] = m_prevY[body] = y;} // NOTE not interpolated
+
+    // Get the position a fraction of the way through the last step
+    float getPosX(int body, float alpha) const {return m_prevX[body] + (m_posX[body] - m_prevX[body]) * alpha;}
+    float getPosY(int body, float alpha) const {return m_prevY[body] + (m_posY[body] - m_prevY[body]) * alpha;}
+
+    // Get the furthest any body moved along either axis over the last step
+    float getMaxStep() const;
+
+    float getVelX(int body) const {return m_velX[body];}
+    float getVelY(int body) const {return m_velY[body];}
+    void setVelocity(int body, float x, float y) {m_velX[body] = x; m_velY[body] = y;}
+    void addAcceleration(int body, float x, float y) {m_accX[body] += x; m_accY[body] += y;}
+
+    void load(int body, Physics& physics) const;
+};
@@ -0,0 +1,179 @@
+#include "RenderQueue.hpp"
+#include "TileMap.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <cassert>
+
+struct RenderQueue::Snapshot
+{
+    TileMap tilemap;
+    TileSet tileset;
+    TileMask mask;
+    bool used = false;
+};
+
+RenderQueue::RenderQueue(): m_color{1.f, 1.f, 1.f}, m_layer(0)
+{
+}
+
+RenderQueue::~RenderQueue()
+{
+}
+
+void RenderQueue::clear()
+{
+    m_commands.clear();
+    m_cameras.clear();
+    m_points.clear();
+    m_layer = 0;
+}
+
+void RenderQueue::sort()
+{
+    std::stable_sort(m_commands.begin(), m_commands.end(), [](const Command& a, const Command& b)
+    {
+        if (a.canvas != b.canvas)
+            return a.canvas < b.canvas;
+        if (a.layer != b.layer)
+            return a.layer < b.layer;
+        return a.order < b.order;
+    });
+}
+
+void RenderQueue::detach()
+{
+    for (auto& snapshot : m_snapshots)
+        snapshot.second->used = false;
+
+    for (auto& command : m_commands)
+    {
+        if (command.type != Command::Tiles)
+            continue;
+
+        auto& snapshot = m_snapshots[command.tilemap];
+        if (!snapshot)
+            snapshot.reset(new Snapshot());
+
+        updateSnapshot(*snapshot, command.tilemap);
+        snapshot->used = true;
+        command.tilemap = &snapshot->tilemap;
+    }
+
+    // Drop copies of maps no longer drawn
+    for (auto it = m_snapshots.begin(); it != m_snapshots.end();)
+        it = it->second->used ? std::next(it) : m_snapshots.erase(it);
+}
+
+void RenderQueue::submit(IRenderer* renderer) const
+{
+    assert(renderer != nullptr);
+
+    int canvas = -1;
+    for (auto& command : m_commands)
+    {
+        if (command.canvas != canvas)
+        {
+            if (canvas >= 0)
+                renderer->popCameraTransform();
+
+            canvas = command.canvas;
+            Transform camera = m_cameras[canvas];
+            renderer->pushCameraTransform(camera);
+        }
+
+        Transform model = command.model;
+        renderer->pushModelTransform(model);
+        renderer->setLayer(command.layer);
+        renderer->setColor(command.red, command.green, command.blue);
+
+        switch (command.type)
+        {
+        case Command::Sprite:
+            renderer->drawSprite(command.texture);
+            break;
+        case Command::Tiles:
+            renderer->drawTiles(command.tilemap);
+            break;
+        case Command::Lines:
+            renderer->drawLines(m_points.data() + command.points.first, command.points.count);
+            break;
+        }
+
+        renderer->popModelTransform();
+    }
+
+    if (canvas >= 0)
+        renderer->popCameraTransform();
+}
+
+void RenderQueue::updateSnapshot(Snapshot& snapshot, const TileMap* tilemap)
+{
+    assert(tilemap->m_tileset != nullptr);
+    TileMap& copy = snapshot.tilemap;
+
+    // NOTE changing the tileset or mask invalidates the map's chunks, so comparing stamps catches those too
+    if (copy.m_tileset == nullptr || copy.m_chunks != tilemap->m_chunks)
+    {
+        copy.m_map = tilemap->m_map;
+        copy.m_cols = tilemap->m_cols;
+        copy.m_rows = tilemap->m_rows;
+        copy.m_chunks = tilemap->m_chunks;
+        snapshot.tileset = *tilemap->m_tileset;
+        copy.m_tileset = &snapshot.tileset;
+        copy.m_mask = nullptr;
+    }
+
+    const TileMask* mask = tilemap->m_mask;
+    if (mask && (copy.m_mask == nullptr || snapshot.mask.m_chunks != mask->m_chunks))
+    {
+        snapshot.mask = *mask;
+        copy.m_mask = &snapshot.mask;
+    }
+}
+
+RenderQueue::Command& RenderQueue::addCommand(Command::Type type, const ResourceHandle& texture)
+{
+    assert(!m_cameras.empty());
+
+    m_commands.emplace_back();
+    Command& command = m_commands.back();
+    command.type = type;
+    command.canvas = int16_t(m_cameras.size() - 1);
+    command.layer = m_layer;
+    command.order = texture.getIndex();
+    command.model = m_model;
+    command.red = m_color.r;
+    command.green = m_color.g;
+    command.blue = m_color.b;
+    command.texture = texture;
+    return command;
+}
+
+void RenderQueue::drawSprite(const ResourceHandle& handle)
+{
+    addCommand(Command::Sprite, handle);
+}
+
+void RenderQueue::drawTiles(const TileMap* tilemap)
+{
+    assert(tilemap != nullptr);
+    const TileSet* tileset = tilemap->getTileSet();
+    if (!tileset)
+        return;
+
+    addCommand(Command::Tiles, tileset->getTexture()).tilemap = tilemap;
+}
+
+void RenderQueue::drawLines(const float* points, size_t count)
+{
+    if (count == 0)
+        return;
+
+    // NOTE lines are only used for debugging, so draw them over everything else in their layer
+    Command& command = addCommand(Command::Lines, ResourceHandle());
+    command.order = std::numeric_limits<int32_t>::max();
+    command.points = {int(m_points.size()), int(count)};
+    m_points.insert(m_points.end(), points, points + count);
+}
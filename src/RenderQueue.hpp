@@ -0,0 +1,86 @@
+#pragma once
+
+#include "IRenderer.hpp"
+
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <cstdint>
+
+// Render calls recorded as flat commands, so they can be sorted before being passed on to a renderer
+// NOTE commands are kept until cleared, so a frame may be submitted more than once, e.g. for benchmarking
+class RenderQueue : public IRenderer
+{
+public:
+    struct Command
+    {
+        enum Type : uint8_t {Sprite, Tiles, Lines};
+
+        // Range of points recorded by drawLines
+        struct Range
+        {
+            int first, count;
+        };
+
+        Type type;
+        int16_t canvas; // index into m_cameras; each Canvas pushes its camera once
+        int32_t layer;
+        int32_t order; // texture index within a layer; lines are drawn last
+        Transform model;
+        float red, green, blue;
+        ResourceHandle texture; // sprite or tileset texture
+        union
+        {
+            const TileMap* tilemap;
+            Range points;
+        };
+    };
+
+private:
+    struct Snapshot;
+
+    std::vector<Command> m_commands;
+    std::vector<Transform> m_cameras;
+    std::vector<float> m_points;
+    Transform m_model;
+    struct {float r, g, b;} m_color;
+    int m_layer;
+    std::unordered_map<const TileMap*, std::unique_ptr<Snapshot>> m_snapshots; // copies of TileMaps drawn, by original
+
+public:
+    RenderQueue(); // NOTE defined with Snapshot
+    ~RenderQueue() override;
+
+    void clear();
+
+    // Point commands at copies of their TileMaps owned by the queue, so it can be submitted while the scene changes
+    // NOTE copies are kept between frames and only taken again once the map's chunks change
+    void detach();
+
+    // Order commands by canvas, then layer, then texture, keeping the recorded order otherwise
+    void sort();
+
+    // Pass the commands on to a renderer, in order
+    void submit(IRenderer* renderer) const;
+
+    const std::vector<Command>& getCommands() const {return m_commands;}
+
+    void preRender() override {}
+    void postRender() override {}
+
+    void pushModelTransform(Transform& transform) override {m_model = transform;}
+    void pushCameraTransform(Transform& transform) override {m_cameras.push_back(transform);}
+
+    void setLayer(int layer) override {m_layer = layer;}
+    void setColor(float red, float green, float blue) override {m_color = {red, green, blue};}
+    void drawSprite(const ResourceHandle& handle) override;
+    void drawTiles(const TileMap* tilemap) override;
+    void drawLines(const float* points, size_t count) override;
+
+    void popModelTransform() override {}
+    void popCameraTransform() override {}
+
+private:
+    Command& addCommand(Command::Type type, const ResourceHandle& texture);
+    static void updateSnapshot(Snapshot& snapshot, const TileMap* tilemap);
+};
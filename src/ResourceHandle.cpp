@@ -0,0 +1,37 @@
+#include "ResourceHandle.hpp"
+
+#include <cassert>
+
+std::deque<std::string> ResourceHandle::s_names;
+std::unordered_map<std::string, int> ResourceHandle::s_indices;
+std::mutex ResourceHandle::s_mutex;
+
+ResourceHandle::ResourceHandle(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+
+    // Reuse the index if the name has already been interned
+    auto it = s_indices.find(name);
+    if (it != s_indices.end())
+    {
+        m_index = it->second;
+        return;
+    }
+
+    m_index = int(s_names.size());
+    s_names.push_back(name);
+    s_indices.emplace(name, m_index);
+}
+
+const std::string& ResourceHandle::getName() const
+{
+    assert(isValid());
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return s_names[m_index];
+}
+
+int ResourceHandle::getCount()
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return int(s_names.size());
+}
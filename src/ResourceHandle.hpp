@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+
+// Resource name interned once, so renderers can find the resource by index instead of by name every frame
+// NOTE names are never released; interning locks, so handles may be created while another thread renders
+class ResourceHandle
+{
+    int m_index;
+
+    static std::deque<std::string> s_names; // NOTE a deque, so names stay put as more are added
+    static std::unordered_map<std::string, int> s_indices;
+    static std::mutex s_mutex;
+
+public:
+    ResourceHandle(): m_index(-1) {}
+    explicit ResourceHandle(const std::string& name);
+
+    bool isValid() const {return m_index >= 0;}
+    int getIndex() const {return m_index;}
+    const std::string& getName() const;
+
+    bool operator==(const ResourceHandle& other) const {return m_index == other.m_index;}
+    bool operator!=(const ResourceHandle& other) const {return m_index != other.m_index;}
+
+    // Get the number of names interned so far, i.e. one more than the greatest index
+    static int getCount();
+};
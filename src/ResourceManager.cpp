@@ -8,6 +8,7 @@ bool findFile(const char* name, std::string& fullpath);
 IResourcePtr ResourceManager::getResource(const std::string& name)
 {
     IResourcePtr ptr;
+    std::lock_guard<std::mutex> lock(m_mutex);
 
     // Copy the pointer if we've already bound it
     auto it = m_ptrMap.find(name);
@@ -5,11 +5,13 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <mutex>
 
 class ResourceManager
 {
 private:
     std::map<std::string, IResourcePtr> m_ptrMap;
+    std::mutex m_mutex; // NOTE audio may be loaded on the simulation thread while textures load on the render thread
 
 public:
     ResourceManager() {}
@@ -17,5 +19,5 @@ public:
 
     IResourcePtr getResource(const std::string& name);
     bool loadRawData(const std::string& name, std::vector<char>& data);
-    void bindResource(const std::string& name, IResourcePtr resource) {m_ptrMap[name] = resource;}
+    void bindResource(const std::string& name, IResourcePtr resource) {std::lock_guard<std::mutex> lock(m_mutex); m_ptrMap[name] = resource;}
 };
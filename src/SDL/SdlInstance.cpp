@@ -1,6 +1,8 @@
 #include "SDLInstance.hpp"
 #include "SdlRenderer.hpp"
 #include "SdlAudio.hpp"
+#include "FramePipeline.hpp"
+#include "RenderQueue.hpp"
 
 #include <cstdio>
 #include "SDL_opengl.h"
@@ -26,12 +28,21 @@ void SdlInstance::run(const char* script)
     instance.pollEvents();
     //fprintf(stderr, "First poll: %f\n", (SDL_GetPerformanceCounter() - lastTime) * period);
 
+    if (instance.m_scene->isPipelined())
+    {
+        instance.runPipelined();
+        return;
+    }
+
     lastTime = SDL_GetPerformanceCounter();
     while (!instance.isQuit())
     {
         // Render first; returns right after vsync
         instance.render();
 
+        // Collect garbage in the time left before the next frame is due
+        instance.m_scene->collectGarbage();
+
         // We could improve the input latency by sleeping after vsync to push input/update closer to next vsync
         //SDL_Delay(8);
 
@@ -109,89 +120,167 @@ bool SdlInstance::init(const char* script)
     return true;
 }
 
+void SdlInstance::runPipelined()
+{
+    // NOTE the SDL renderer has to stay on the thread that created the window, so simulation moves off it instead
+    FramePipeline pipeline;
+    RenderQueue queues[2];
+    int front = 0;
+
+    uint64_t lastTime = SDL_GetPerformanceCounter();
+    const float period = 1.f / float(SDL_GetPerformanceFrequency());
+    while (!isQuit())
+    {
+        queueEvents();
+
+        const uint64_t currentTime = SDL_GetPerformanceCounter();
+        const float elapsedTime = (currentTime - lastTime) * period;
+        lastTime = currentTime;
+
+        // Update and record the next frame while the last one is drawn
+        RenderQueue& back = queues[1 - front];
+        pipeline.start([this, &back, elapsedTime]
+        {
+            for (auto& e : m_events)
+                handleEvent(e);
+            m_events.clear();
+
+            update(elapsedTime);
+            m_scene->playAudio(m_audio.get());
+            m_scene->record(back);
+            back.detach();
+
+            // Collect garbage while the last frame is drawn
+            m_scene->collectGarbage();
+        });
+
+        // Returns right after vsync
+        m_renderer->preRender();
+        queues[front].submit(m_renderer.get());
+        m_renderer->postRender();
+
+        pipeline.wait();
+        front = 1 - front;
+    }
+}
+
 void SdlInstance::pollEvents()
 {
     SDL_Event e;
     while (SDL_PollEvent(&e) != 0)
     {
+        handleEvent(e);
+        if (e.type == SDL_QUIT)
+            return;
+    }
+}
+
+void SdlInstance::queueEvents()
+{
+    SDL_Event e;
+    while (SDL_PollEvent(&e) != 0)
+    {
+        // Events that don't reach the scene are handled right away, on the thread owning the renderer
         switch (e.type)
         {
-        case SDL_QUIT:
-            m_bQuit = true;
-            return;
-        case SDL_KEYDOWN:
-        case SDL_KEYUP:
-            handleKeyEvent(e.key);
-            break;
-        case SDL_MOUSEMOTION:
-            //if (SDL_GetRelativeMouseMode() == SDL_TRUE)
-            //    fprintf(stderr, "Mouse motion: %d, %d\n", e.motion.xrel, e.motion.yrel);
-            //else
-            //    fprintf(stderr, "Mouse position: %d, %d\n", e.motion.x, e.motion.y);
-            break;
-        case SDL_MOUSEBUTTONDOWN:
-        case SDL_MOUSEBUTTONUP:
-            handleMouseButtonEvent(e.button);
-            break;
         case SDL_CONTROLLERDEVICEADDED:
-            //SDL_NumJoysticks()
-            //SDL_IsGameController(e.cdevice.which)
-            {
-                SDL_GameController* controller = SDL_GameControllerOpen(e.cdevice.which);
-                if (!controller)
-                {
-                    fprintf(stderr, "Failed to acquire controller: %s\n", SDL_GetError());
-                    break;
-                }
-                const char* name = SDL_GameControllerName(controller);
-                //const char* name = SDL_GameControllerNameForIndex(e.cdevice.which);
-                if (name)
-                    fprintf(stderr, "%s (%d) added\n", name, e.cdevice.which);
-                else
-                    fprintf(stderr, "Nameless controller %d added\n", e.cdevice.which);
-            }
-            break;
         case SDL_CONTROLLERDEVICEREMOVED:
-            {
-                SDL_GameController* controller = SDL_GameControllerFromInstanceID(e.cdevice.which);
-                if (!controller)
-                {
-                    fprintf(stderr, "Controller instance %d removed; failed: %s\n", e.cdevice.which, SDL_GetError());
-                    break;
-                }
-                const char* name = SDL_GameControllerName(controller);
-                if (name)
-                    fprintf(stderr, "%s (%d) removed\n", name, e.cdevice.which);
-                else
-                    fprintf(stderr, "Controller instance %d removed, no name\n", e.cdevice.which);
-                SDL_GameControllerClose(controller);
-            }
+        case SDL_RENDER_TARGETS_RESET:
+        case SDL_RENDER_DEVICE_RESET:
+            handleEvent(e);
             break;
-        //SDL_CONTROLLERDEVICEREMAPPED
-        case SDL_CONTROLLERBUTTONDOWN:
-        case SDL_CONTROLLERBUTTONUP:
-            handleGamepadButtonEvent(e.cbutton);
+        default:
+            m_events.push_back(e);
             break;
-        case SDL_CONTROLLERAXISMOTION:
-            handleGamepadAxisEvent(e.caxis);
-            break;
-        case SDL_WINDOWEVENT:
-            //if (SDL_GetWindowFromID(e.window.windowID) != m_window)
-            //    break;
-            switch (e.window.event)
+        }
+    }
+}
+
+void SdlInstance::handleEvent(SDL_Event& e)
+{
+    switch (e.type)
+    {
+    case SDL_QUIT:
+        m_bQuit = true;
+        break;
+    case SDL_KEYDOWN:
+    case SDL_KEYUP:
+        handleKeyEvent(e.key);
+        break;
+    case SDL_MOUSEMOTION:
+        //if (SDL_GetRelativeMouseMode() == SDL_TRUE)
+        //    fprintf(stderr, "Mouse motion: %d, %d\n", e.motion.xrel, e.motion.yrel);
+        //else
+        //    fprintf(stderr, "Mouse position: %d, %d\n", e.motion.x, e.motion.y);
+        break;
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+        handleMouseButtonEvent(e.button);
+        break;
+    case SDL_CONTROLLERDEVICEADDED:
+        //SDL_NumJoysticks()
+        //SDL_IsGameController(e.cdevice.which)
+        {
+            SDL_GameController* controller = SDL_GameControllerOpen(e.cdevice.which);
+            if (!controller)
+            {
+                fprintf(stderr, "Failed to acquire controller: %s\n", SDL_GetError());
+                break;
+            }
+            const char* name = SDL_GameControllerName(controller);
+            //const char* name = SDL_GameControllerNameForIndex(e.cdevice.which);
+            if (name)
+                fprintf(stderr, "%s (%d) added\n", name, e.cdevice.which);
+            else
+                fprintf(stderr, "Nameless controller %d added\n", e.cdevice.which);
+        }
+        break;
+    case SDL_CONTROLLERDEVICEREMOVED:
+        {
+            SDL_GameController* controller = SDL_GameControllerFromInstanceID(e.cdevice.which);
+            if (!controller)
             {
-            case SDL_WINDOWEVENT_RESIZED:
-                //int width, height;
-                //SDL_GL_GetDrawableSize(m_window, &width, &height);
-                //SDL_GetRendererOutputSize(m_renderer, &width, &height);
-                //fprintf(stderr, "Framebuffer size: %dx%d\n", width, height);
-                //fprintf(stderr, "Window size: %dx%d\n", e.window.data1, e.window.data2);
-                // NOTE just using logical window size instead of framebuffer pixel size
-                m_scene->resize(e.window.data1, e.window.data2);
+                fprintf(stderr, "Controller instance %d removed; failed: %s\n", e.cdevice.which, SDL_GetError());
                 break;
             }
+            const char* name = SDL_GameControllerName(controller);
+            if (name)
+                fprintf(stderr, "%s (%d) removed\n", name, e.cdevice.which);
+            else
+                fprintf(stderr, "Controller instance %d removed, no name\n", e.cdevice.which);
+            SDL_GameControllerClose(controller);
+        }
+        break;
+    //SDL_CONTROLLERDEVICEREMAPPED
+    case SDL_CONTROLLERBUTTONDOWN:
+    case SDL_CONTROLLERBUTTONUP:
+        handleGamepadButtonEvent(e.cbutton);
+        break;
+    case SDL_CONTROLLERAXISMOTION:
+        handleGamepadAxisEvent(e.caxis);
+        break;
+    case SDL_WINDOWEVENT:
+        //if (SDL_GetWindowFromID(e.window.windowID) != m_window)
+        //    break;
+        switch (e.window.event)
+        {
+        case SDL_WINDOWEVENT_RESIZED:
+            //int width, height;
+            //SDL_GL_GetDrawableSize(m_window, &width, &height);
+            //SDL_GetRendererOutputSize(m_renderer, &width, &height);
+            //fprintf(stderr, "Framebuffer size: %dx%d\n", width, height);
+            //fprintf(stderr, "Window size: %dx%d\n", e.window.data1, e.window.data2);
+            // NOTE just using logical window size instead of framebuffer pixel size
+            m_scene->resize(e.window.data1, e.window.data2);
             break;
         }
+        break;
+    case SDL_RENDER_TARGETS_RESET:
+    case SDL_RENDER_DEVICE_RESET:
+        // Cached TileMap chunks are render targets, so their contents may be lost
+        if (m_renderer)
+            static_cast<SdlRenderer*>(m_renderer.get())->resetTileCaches();
+        break;
     }
 }
 
@@ -201,7 +290,7 @@ void SdlInstance::update(float elapsedTime)
         return;
 
     // Send elapsed time down to game objects
-    m_scene->update(elapsedTime);
+    m_scene->advance(elapsedTime);
 }
 
 void SdlInstance::render()
@@ -5,6 +5,7 @@
 #include "ResourceManager.hpp"
 #include "Scene.hpp"
 
+#include <vector>
 #include <memory>
 #include "SDL.h"
 
@@ -18,6 +19,7 @@ class SdlInstance
     IRendererPtr m_renderer;
     IAudioPtr m_audio;
     ScenePtr m_scene;
+    std::vector<SDL_Event> m_events; // polled while pipelined, to be handled on the simulation thread
     bool m_bQuit;
 
 public:
@@ -29,12 +31,15 @@ private:
     SdlInstance(): m_bQuit(false) {}
 
     bool init(const char* script);
+    void runPipelined();
     void pollEvents();
+    void queueEvents();
     void update(float elapsedTime);
     void render();
 
     bool isQuit() const {return m_bQuit;}
 
+    void handleEvent(SDL_Event& e);
     void handleKeyEvent(SDL_KeyboardEvent& e);
     void handleMouseButtonEvent(SDL_MouseButtonEvent& e);
     void handleGamepadButtonEvent(SDL_ControllerButtonEvent& e);
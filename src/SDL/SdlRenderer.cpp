@@ -3,8 +3,12 @@
 
 #include "SDL.h"
 
+#include <algorithm>
+
 SdlRenderer::~SdlRenderer()
 {
+    resetTileCaches();
+
     if (m_renderer)
         SDL_DestroyRenderer(m_renderer);
 
@@ -82,12 +86,49 @@ void SdlRenderer::preRender()
     SDL_SetRenderDrawColor(m_renderer, 0, 0, 0, 255);
     SDL_RenderClear(m_renderer);
     SDL_GetRendererOutputSize(m_renderer, &m_width, &m_height);
+
+    m_boundTexture = nullptr;
+    m_drawCalls = 0;
+    m_textureSwitches = 0;
+    ++m_frame;
 }
 
 void SdlRenderer::postRender()
 {
+    flushSprites();
+
     //SDL_GL_SwapWindow(m_window);
     SDL_RenderPresent(m_renderer);
+
+    m_lastDrawCalls = m_drawCalls;
+    m_lastTextureSwitches = m_textureSwitches;
+
+    // Release the chunks of TileMaps that are no longer drawn
+    // NOTE caches are keyed by address, so a destroyed TileMap is only detected this way
+    for (auto it = m_tileCaches.begin(); it != m_tileCaches.end();)
+    {
+        if (m_frame - it->second.lastFrame > TileCacheFrames)
+        {
+            releaseTileCache(it->second);
+            it = m_tileCaches.erase(it);
+        }
+        else
+            ++it;
+    }
+
+//#define RENDER_STATS
+#ifdef RENDER_STATS
+    // NOTE averages are reported every 60 frames
+    static int frames = 0, drawCalls = 0, textureSwitches = 0;
+    drawCalls += m_drawCalls;
+    textureSwitches += m_textureSwitches;
+    if (++frames == 60)
+    {
+        fprintf(stderr, "draw calls: %d, texture switches: %d per frame\n", drawCalls / frames, textureSwitches / frames);
+        fprintf(stderr, "atlas pages: %d, %.1f%% occupied\n", m_atlas.getPageCount(), m_atlas.getOccupancy() * 100.f);
+        frames = drawCalls = textureSwitches = 0;
+    }
+#endif
 }
 
 void SdlRenderer::setColor(float red, float green, float blue)
@@ -99,27 +140,180 @@ void SdlRenderer::setColor(float red, float green, float blue)
 	m_color.b = uint8_t(std::min(std::max(blue * 255.f, 0.f), 255.f));
 }
 
-void SdlRenderer::drawSprite(const std::string& name)
+SdlTexture* SdlRenderer::getTexture(const ResourceHandle& handle)
 {
-    // Get texture resource
-    SdlTexturePtr texture = SdlTexture::loadTexture(m_resources, m_renderer, name);
+    assert(handle.isValid());
+    if (handle.getIndex() >= int(m_textures.size()))
+        m_textures.resize(ResourceHandle::getCount(), nullptr);
+
+    // Load the texture resource the first time the handle is used
+    // NOTE the resource manager keeps the texture alive, so only the pointer is kept here
+    SdlTexture*& texture = m_textures[handle.getIndex()];
     if (!texture)
+        texture = SdlTexture::loadTexture(m_resources, m_renderer, handle.getName()).get();
+
+    return texture;
+}
+
+const SdlRenderer::SpriteSource* SdlRenderer::getSpriteSource(const ResourceHandle& handle)
+{
+    assert(handle.isValid());
+    if (handle.getIndex() >= int(m_spriteSources.size()))
+        m_spriteSources.resize(ResourceHandle::getCount());
+
+    SpriteSource& source = m_spriteSources[handle.getIndex()];
+    if (source.texture)
+        return &source;
+
+    // Pack small images into atlas pages, so sprites of different images can be drawn together
+    std::vector<char> data;
+    TextureAtlas::Image image;
+    TextureAtlas::Rect rect;
+    int width, height;
+    if (m_resources.loadRawData(handle.getName(), data) && TextureAtlas::decodeTGA(data, image) && m_atlas.pack(image.width, image.height, rect))
+    {
+        while (int(m_atlasPages.size()) <= rect.page)
+        {
+            SdlTexturePtr page = SdlTexture::createBlank(m_renderer, TextureAtlas::PageSize, TextureAtlas::PageSize);
+            if (!page)
+                return nullptr;
+            m_atlasPages.push_back(page);
+        }
+
+        // Copy the image along with its padding
+        TextureAtlas::Image padded;
+        TextureAtlas::addPadding(image, padded);
+        const SDL_Rect target = {rect.x - TextureAtlas::Padding, rect.y - TextureAtlas::Padding, padded.width, padded.height};
+        SdlTexture* page = m_atlasPages[rect.page].get();
+        if (!page->update(target, padded.pixels.data(), padded.width * 4))
+            return nullptr;
+
+        source.texture = page->getPtr();
+        source.rect = {rect.x, rect.y, rect.width, rect.height};
+        width = page->getWidth();
+        height = page->getHeight();
+    }
+    else
+    {
+        // Otherwise the image keeps a texture of its own
+        SdlTexture* texture = getTexture(handle);
+        if (!texture)
+            return nullptr;
+
+        source.texture = texture->getPtr();
+        source.rect = {0, 0, texture->getWidth(), texture->getHeight()};
+        width = texture->getWidth();
+        height = texture->getHeight();
+    }
+
+    source.u0 = float(source.rect.x) / width;
+    source.v0 = float(source.rect.y) / height;
+    source.u1 = float(source.rect.x + source.rect.w) / width;
+    source.v1 = float(source.rect.y + source.rect.h) / height;
+    return &source;
+}
+
+void SdlRenderer::drawSprite(const ResourceHandle& handle)
+{
+    // Get the texture and region holding the sprite
+    const SpriteSource* source = getSpriteSource(handle);
+    if (!source)
         return; // TODO: we should at least have a placeholder instead of null; assert here?
 
-    // Apply the render color to the texture
-    SDL_SetTextureColorMod(texture->getPtr(), m_color.r, m_color.g, m_color.b);
+    Sprite sprite;
+    sprite.texture = source->texture;
+    sprite.source = source->rect;
+    sprite.u0 = source->u0;
+    sprite.v0 = source->v0;
+    sprite.u1 = source->u1;
+    sprite.v1 = source->v1;
+    sprite.color = {m_color.r, m_color.g, m_color.b, 255};
+    sprite.run = m_run;
 
     // Set the destination rect where we will draw the texture
-    SDL_Rect target;
     const float scaleW = m_width / m_camera.getScaleX();
     const float scaleH = m_height / m_camera.getScaleY();
-    target.w = int(ceil(m_model.getScaleX() * scaleW));
-    target.h = int(ceil(m_model.getScaleY() * scaleH));
-    target.x = int(floor((m_model.getX() - m_camera.getX()) * scaleW));
-    target.y = int(floor((m_model.getY() - m_camera.getY()) * scaleH));
+    sprite.target.w = int(ceil(m_model.getScaleX() * scaleW));
+    sprite.target.h = int(ceil(m_model.getScaleY() * scaleH));
+    sprite.target.x = int(floor((m_model.getX() - m_camera.getX()) * scaleW));
+    sprite.target.y = int(floor((m_model.getY() - m_camera.getY()) * scaleH));
+
+    // Sprites of the same texture are drawn together, in order of the texture's first use in this run
+    auto it = std::find(m_runTextures.begin(), m_runTextures.end(), sprite.texture);
+    sprite.order = int(it - m_runTextures.begin());
+    if (it == m_runTextures.end())
+        m_runTextures.push_back(sprite.texture);
+
+    // Draw the texture later, along with others
+    m_sprites.push_back(sprite);
+}
 
-    // Draw the texture
-    SDL_RenderCopy(m_renderer, texture->getPtr(), nullptr, &target);
+void SdlRenderer::flushSprites()
+{
+    if (m_sprites.empty())
+        return;
+
+    // NOTE runs are already in order, so sprites only move within their own run
+    std::stable_sort(m_sprites.begin(), m_sprites.end(), [](const Sprite& a, const Sprite& b)
+        {return a.run != b.run ? a.run < b.run : a.order < b.order;});
+
+    // Draw each span of sprites sharing a texture with a single call
+    const int count = int(m_sprites.size());
+    for (int first = 0, last = 0; first < count; first = last)
+    {
+        SDL_Texture* texture = m_sprites[first].texture;
+        while (last < count && m_sprites[last].texture == texture)
+            ++last;
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        // Color is applied per vertex instead of changing the texture's color mod
+        m_vertices.clear();
+        m_indices.clear();
+        for (int i = first; i < last; ++i)
+        {
+            const Sprite& sprite = m_sprites[i];
+            const float left = float(sprite.target.x);
+            const float top = float(sprite.target.y);
+            const float right = float(sprite.target.x + sprite.target.w);
+            const float bottom = float(sprite.target.y + sprite.target.h);
+
+            const int index = int(m_vertices.size());
+            m_vertices.push_back({{left, top}, sprite.color, {sprite.u0, sprite.v0}});
+            m_vertices.push_back({{right, top}, sprite.color, {sprite.u1, sprite.v0}});
+            m_vertices.push_back({{right, bottom}, sprite.color, {sprite.u1, sprite.v1}});
+            m_vertices.push_back({{left, bottom}, sprite.color, {sprite.u0, sprite.v1}});
+
+            const int quad[] = {0, 1, 2, 0, 2, 3};
+            for (int corner : quad)
+                m_indices.push_back(index + corner);
+        }
+
+        SDL_SetTextureColorMod(texture, 255, 255, 255);
+        SDL_RenderGeometry(m_renderer, texture, m_vertices.data(), int(m_vertices.size()), m_indices.data(), int(m_indices.size()));
+        countDraw(texture);
+#else
+        for (int i = first; i < last; ++i)
+        {
+            const Sprite& sprite = m_sprites[i];
+            SDL_SetTextureColorMod(texture, sprite.color.r, sprite.color.g, sprite.color.b);
+            SDL_RenderCopy(m_renderer, texture, &sprite.source, &sprite.target);
+            countDraw(texture);
+        }
+#endif
+    }
+
+    m_sprites.clear();
+    m_runTextures.clear();
+}
+
+void SdlRenderer::countDraw(SDL_Texture* texture)
+{
+    ++m_drawCalls;
+    if (texture != m_boundTexture)
+    {
+        ++m_textureSwitches;
+        m_boundTexture = texture;
+    }
 }
 
 void SdlRenderer::drawTiles(const TileMap* tilemap)
@@ -129,21 +323,38 @@ void SdlRenderer::drawTiles(const TileMap* tilemap)
     if (!tileset)
         return;
 
+    // Tiles are drawn straight away, so draw any sprites recorded before them first
+    flushSprites();
+
     // Get texture resource
-    SdlTexturePtr texture = SdlTexture::loadTexture(m_resources, m_renderer, tileset->getFilename());
+    SdlTexture* texture = getTexture(tileset->getTexture());
     if (!texture)
         return; // TODO: we should at least have a placeholder instead of null; assert here?
 
-    const TileMask* tileMask = tilemap->getTileMask();
-
-    // Apply the render color to the texture
-    SDL_SetTextureColorMod(texture->getPtr(), m_color.r, m_color.g, m_color.b);
-
     // Set the source rect from which we will draw the texture
     SDL_Rect source;
     source.w = texture->getWidth() / tileset->getCols();
     source.h = texture->getHeight() / tileset->getRows();
 
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    // Masked maps are shaded per corner in a single call, so light fades smoothly across tiles
+    // NOTE masks tend to change every frame, e.g. for fog of war, so they aren't worth caching in chunks
+    if (tilemap->getTileMask())
+    {
+        drawMaskedTiles(tilemap, texture, source.w, source.h);
+        return;
+    }
+#endif
+
+    // Copy pre-rendered chunks if possible, otherwise fall back to drawing each tile
+    if (drawTileChunks(tilemap, texture->getPtr(), source.w, source.h))
+        return;
+
+    const TileMask* tileMask = tilemap->getTileMask();
+
+    // Apply the render color to the texture
+    SDL_SetTextureColorMod(texture->getPtr(), m_color.r, m_color.g, m_color.b);
+
     // Compute the scale from camera to screen
     const float scaleW = m_width / m_camera.getScaleX();
     const float scaleH = m_height / m_camera.getScaleY();
@@ -161,16 +372,18 @@ void SdlRenderer::drawTiles(const TileMap* tilemap)
     target.w = int(ceil(floatW));
     target.h = int(ceil(floatH));
 
-    // Iterate over tile (x, y) indices
-    int i = 0;
-    float yf = originY;
-    for (int y = 0; y < tilemap->getRows(); ++y, yf += floatH)
+    // Only iterate over tile (x, y) indices in view
+    int left, top, right, bottom;
+    getVisibleTiles(m_model, m_camera, tilemap->getCols(), tilemap->getRows(), left, top, right, bottom);
+
+    float yf = originY + top * floatH;
+    for (int y = top; y < bottom; ++y, yf += floatH)
     {
-        float xf = originX;
-        for (int x = 0; x < tilemap->getCols(); ++x, xf += floatW)
+        float xf = originX + left * floatW;
+        for (int x = left; x < right; ++x, xf += floatW)
         {
             // Skip if tile index invalid (blank tile)
-            const int tile = tilemap->getIndex(i++);
+            const int tile = tilemap->getIndex(x, y);
             if (!tileset->isValidIndex(tile))
                 continue;
 
@@ -196,8 +409,262 @@ void SdlRenderer::drawTiles(const TileMap* tilemap)
 
             // Draw the texture
             SDL_RenderCopy(m_renderer, texture->getPtr(), &source, &target);
+            countDraw(texture->getPtr());
+        }
+    }
+}
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+void SdlRenderer::drawMaskedTiles(const TileMap* tilemap, SdlTexture* texture, int tileW, int tileH)
+{
+    const TileSet* tileset = tilemap->getTileSet();
+    const TileMask* tileMask = tilemap->getTileMask();
+
+    // Compute the scale from camera to screen
+    const float scaleW = m_width / m_camera.getScaleX();
+    const float scaleH = m_height / m_camera.getScaleY();
+
+    // Compute the scale from index to tile (i.e. the size in pixels as float)
+    const float floatW = m_model.getScaleX() * scaleW;
+    const float floatH = m_model.getScaleY() * scaleH;
+
+    // Use the top-left corner of the tilemap as the origin
+    const float originX = (m_model.getX() - m_camera.getX()) * scaleW;
+    const float originY = (m_model.getY() - m_camera.getY()) * scaleH;
+
+    // Compute the texture coordinates of one tile
+    const float texW = float(tileW) / texture->getWidth();
+    const float texH = float(tileH) / texture->getHeight();
+
+    // Only iterate over tile (x, y) indices in view
+    int left, top, right, bottom;
+    getVisibleTiles(m_model, m_camera, tilemap->getCols(), tilemap->getRows(), left, top, right, bottom);
+    tileMask->getCorners(left, top, right, bottom, m_corners);
+    const int pitch = right - left + 1;
+
+    m_vertices.clear();
+    m_indices.clear();
+    for (int y = top; y < bottom; ++y)
+    {
+        for (int x = left; x < right; ++x)
+        {
+            // Skip if tile index invalid (blank tile)
+            const int tile = tilemap->getIndex(x, y);
+            if (!tileset->isValidIndex(tile))
+                continue;
+
+            // Skip tiles that are dark at every corner
+            const uint8_t* corner = &m_corners[(y - top) * pitch + x - left];
+            const uint8_t masks[4] = {corner[0], corner[1], corner[pitch + 1], corner[pitch]};
+            if (!(masks[0] | masks[1] | masks[2] | masks[3]))
+                continue;
+
+            SDL_Color colors[4];
+            for (int i = 0; i < 4; ++i)
+                colors[i] = {uint8_t(m_color.r * masks[i] / 255), uint8_t(m_color.g * masks[i] / 255), uint8_t(m_color.b * masks[i] / 255), 255};
+
+            // NOTE both edges are computed from the origin, so neighbouring tiles share them exactly
+            const float x0 = originX + x * floatW, x1 = originX + (x + 1) * floatW;
+            const float y0 = originY + y * floatH, y1 = originY + (y + 1) * floatH;
+            const float u0 = tileset->getIndexCol(tile) * texW, u1 = u0 + texW;
+            const float v0 = tileset->getIndexRow(tile) * texH, v1 = v0 + texH;
+
+            const int index = int(m_vertices.size());
+            m_vertices.push_back({{x0, y0}, colors[0], {u0, v0}});
+            m_vertices.push_back({{x1, y0}, colors[1], {u1, v0}});
+            m_vertices.push_back({{x1, y1}, colors[2], {u1, v1}});
+            m_vertices.push_back({{x0, y1}, colors[3], {u0, v1}});
+
+            const int quad[] = {0, 1, 2, 0, 2, 3};
+            for (int i : quad)
+                m_indices.push_back(index + i);
+        }
+    }
+
+    if (m_vertices.empty())
+        return;
+
+    SDL_SetTextureColorMod(texture->getPtr(), 255, 255, 255);
+    SDL_RenderGeometry(m_renderer, texture->getPtr(), m_vertices.data(), int(m_vertices.size()), m_indices.data(), int(m_indices.size()));
+    countDraw(texture->getPtr());
+}
+#endif
+
+bool SdlRenderer::drawTileChunks(const TileMap* tilemap, SDL_Texture* texture, int tileW, int tileH)
+{
+    if (!SDL_RenderTargetSupported(m_renderer) || tileW <= 0 || tileH <= 0)
+        return false;
+
+    const TileChunks& chunks = tilemap->getChunks();
+    const TileMask* tileMask = tilemap->getTileMask();
+
+    // Start over if the chunk grid, tile size or tileset texture have changed
+    TileCache& cache = m_tileCaches[tilemap];
+    if (cache.cols != chunks.getCols() || cache.rows != chunks.getRows() || cache.tileW != tileW || cache.tileH != tileH || cache.tileset != texture)
+    {
+        releaseTileCache(cache);
+        cache.chunks.resize(chunks.getCols() * chunks.getRows());
+        cache.tileset = texture;
+        cache.cols = chunks.getCols();
+        cache.rows = chunks.getRows();
+        cache.tileW = tileW;
+        cache.tileH = tileH;
+    }
+
+    cache.lastFrame = m_frame;
+
+    // Only chunks in view are rendered and drawn
+    int left, top, right, bottom;
+    getVisibleTiles(m_model, m_camera, tilemap->getCols(), tilemap->getRows(), left, top, right, bottom);
+    const int chunkLeft = left / TileChunks::Size, chunkRight = (right + TileChunks::Size - 1) / TileChunks::Size;
+    const int chunkTop = top / TileChunks::Size, chunkBottom = (bottom + TileChunks::Size - 1) / TileChunks::Size;
+
+    // Re-render only the chunks whose tiles or mask have changed since they were last rendered
+    // NOTE stamps are never reused, so this also catches a new TileMap at the address of a destroyed one
+    for (int cy = chunkTop; cy < chunkBottom; ++cy)
+    {
+        for (int cx = chunkLeft; cx < chunkRight; ++cx)
+        {
+            TileChunk& chunk = cache.chunks[cy * cache.cols + cx];
+            const uint32_t stamp = chunks.getStamp(cx, cy);
+            const uint32_t maskStamp = tileMask ? tileMask->getChunks().getStamp(cx, cy) : 0;
+            if (chunk.texture && chunk.stamp == stamp && chunk.maskStamp == maskStamp)
+                continue;
+
+            renderTileChunk(tilemap, texture, cache, cx, cy);
+            if (!chunk.texture)
+                return false;
+            chunk.stamp = stamp;
+            chunk.maskStamp = maskStamp;
+        }
+    }
+
+    // Compute the scale from camera to screen
+    const float scaleW = m_width / m_camera.getScaleX();
+    const float scaleH = m_height / m_camera.getScaleY();
+
+    // Compute the size of a chunk in pixels as float
+    const float floatW = m_model.getScaleX() * scaleW * TileChunks::Size;
+    const float floatH = m_model.getScaleY() * scaleH * TileChunks::Size;
+
+    // Use the top-left corner of the tilemap as the origin
+    const float originX = (m_model.getX() - m_camera.getX()) * scaleW;
+    const float originY = (m_model.getY() - m_camera.getY()) * scaleH;
+
+    for (int cy = chunkTop; cy < chunkBottom; ++cy)
+    {
+        for (int cx = chunkLeft; cx < chunkRight; ++cx)
+        {
+            const TileChunk& chunk = cache.chunks[cy * cache.cols + cx];
+
+            // Partial chunks along the right and bottom edges only copy their used part
+            const int tilesX = std::min(TileChunks::Size, tilemap->getCols() - cx * TileChunks::Size);
+            const int tilesY = std::min(TileChunks::Size, tilemap->getRows() - cy * TileChunks::Size);
+            SDL_Rect source = {0, 0, tilesX * tileW, tilesY * tileH};
+
+            // Snap both edges to pixels, so neighbouring chunks neither overlap nor leave gaps
+            const float left = originX + cx * floatW;
+            const float top = originY + cy * floatH;
+            SDL_Rect target;
+            target.x = int(floor(left));
+            target.y = int(floor(top));
+            target.w = int(ceil(left + floatW * tilesX / TileChunks::Size)) - target.x;
+            target.h = int(ceil(top + floatH * tilesY / TileChunks::Size)) - target.y;
+
+            // NOTE the mask is baked into the chunk, so only the render color is applied here
+            SDL_SetTextureColorMod(chunk.texture, m_color.r, m_color.g, m_color.b);
+            SDL_RenderCopy(m_renderer, chunk.texture, &source, &target);
+            countDraw(chunk.texture);
         }
     }
+
+    return true;
+}
+
+void SdlRenderer::renderTileChunk(const TileMap* tilemap, SDL_Texture* texture, TileCache& cache, int cx, int cy)
+{
+    TileChunk& chunk = cache.chunks[cy * cache.cols + cx];
+    if (!chunk.texture)
+    {
+        chunk.texture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET,
+            cache.tileW * TileChunks::Size, cache.tileH * TileChunks::Size);
+        if (!chunk.texture)
+        {
+            fprintf(stderr, "Failed to create tile chunk texture: %s\n", SDL_GetError());
+            return;
+        }
+        SDL_SetTextureBlendMode(chunk.texture, SDL_BLENDMODE_BLEND);
+    }
+
+    if (SDL_SetRenderTarget(m_renderer, chunk.texture))
+    {
+        fprintf(stderr, "Failed to render tile chunk: %s\n", SDL_GetError());
+        SDL_DestroyTexture(chunk.texture);
+        chunk.texture = nullptr;
+        return;
+    }
+
+    // Blank tiles are left transparent
+    SDL_SetRenderDrawColor(m_renderer, 0, 0, 0, 0);
+    SDL_RenderClear(m_renderer);
+
+    const TileSet* tileset = tilemap->getTileSet();
+    const TileMask* tileMask = tilemap->getTileMask();
+    SDL_SetTextureColorMod(texture, 255, 255, 255);
+
+    SDL_Rect source, target;
+    source.w = target.w = cache.tileW;
+    source.h = target.h = cache.tileH;
+
+    const int left = cx * TileChunks::Size, right = std::min(left + TileChunks::Size, tilemap->getCols());
+    const int top = cy * TileChunks::Size, bottom = std::min(top + TileChunks::Size, tilemap->getRows());
+    for (int y = top; y < bottom; ++y)
+    {
+        for (int x = left; x < right; ++x)
+        {
+            // Skip if tile index invalid (blank tile)
+            const int tile = tilemap->getIndex(x, y);
+            if (!tileset->isValidIndex(tile))
+                continue;
+
+            // Bake the mask into the chunk as the tile's color
+            if (tileMask)
+            {
+                const uint8_t mask = tileMask->getMask(x, y);
+                if (mask == 0)
+                    continue;
+
+                const uint8_t value = uint8_t(255 * (mask + 1) / 256);
+                SDL_SetTextureColorMod(texture, value, value, value);
+            }
+
+            source.x = tileset->getIndexCol(tile) * source.w;
+            source.y = tileset->getIndexRow(tile) * source.h;
+            target.x = (x - left) * target.w;
+            target.y = (y - top) * target.h;
+            SDL_RenderCopy(m_renderer, texture, &source, &target);
+            countDraw(texture);
+        }
+    }
+
+    SDL_SetRenderTarget(m_renderer, nullptr);
+}
+
+void SdlRenderer::releaseTileCache(TileCache& cache)
+{
+    for (auto& chunk : cache.chunks)
+    {
+        if (chunk.texture)
+            SDL_DestroyTexture(chunk.texture);
+    }
+    cache.chunks.clear();
+}
+
+void SdlRenderer::resetTileCaches()
+{
+    for (auto& entry : m_tileCaches)
+        releaseTileCache(entry.second);
+    m_tileCaches.clear();
 }
 
 inline void mapColorScale(SDL_Renderer* renderer, float step)
@@ -216,17 +683,22 @@ inline void mapColorScale(SDL_Renderer* renderer, float step)
         SDL_SetRenderDrawColor(renderer, 255, 0, 255, 255);
 }
 
-void SdlRenderer::drawLines(const std::vector<float>& points)
+void SdlRenderer::drawLines(const float* points, size_t count)
 {
+    if (count == 0)
+        return;
+
+    flushSprites();
+
     const float scaleW = m_width / m_camera.getScaleX();
     const float scaleH = m_height / m_camera.getScaleY();
 
-    for (size_t i = 0; i < points.size(); i++)
+    for (size_t i = 0; i < count; i++)
     {
         int segments = int(points[i]);
 
         assert(segments >= 2);
-        assert(i + segments * 2 < points.size());
+        assert(i + segments * 2 < count);
 
         int lastX = int(floor((points[++i] - m_camera.getX()) * scaleW));
         int lastY = int(floor((points[++i] - m_camera.getY()) * scaleH));
@@ -240,6 +712,7 @@ void SdlRenderer::drawLines(const std::vector<float>& points)
             int thisY = int(floor((points[++i] - m_camera.getY()) * scaleH));
             mapColorScale(m_renderer, step); step += stepSize;
             SDL_RenderDrawLine(m_renderer, lastX, lastY, thisX, thisY);
+            countDraw(nullptr);
             lastX = thisX;
             lastY = thisY;
         }
@@ -296,6 +769,32 @@ SdlTexturePtr SdlTexture::loadTexture(ResourceManager& manager, SDL_Renderer* re
     return texture;
 }
 
+SdlTexturePtr SdlTexture::createBlank(SDL_Renderer* renderer, int width, int height)
+{
+    SdlTexturePtr ptr;
+
+    // NOTE static textures start out undefined, so fill it with transparent texels
+    std::vector<uint8_t> pixels(width * height * 4, 0);
+    SDL_Texture* texture = createTexture(renderer, width, height, pixels.data(), width * 4, SDL_PIXELFORMAT_RGBA32);
+    if (!texture)
+        return ptr;
+
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    ptr = SdlTexturePtr(new SdlTexture(texture, width, height));
+    return ptr;
+}
+
+bool SdlTexture::update(const SDL_Rect& rect, const void* pixels, int pitch)
+{
+    if (SDL_UpdateTexture(m_texture, &rect, pixels, pitch))
+    {
+        fprintf(stderr, "Failed update texture: %s\n", SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
+
 SDL_Texture* SdlTexture::createTexture(SDL_Renderer* renderer, int width, int height, const void* data, int pitch, uint32_t format)
 {
     SDL_Texture* texture = SDL_CreateTexture(renderer, format, SDL_TEXTUREACCESS_STATIC, width, height);
@@ -2,13 +2,14 @@
 
 #include "IRenderer.hpp"
 #include "ResourceManager.hpp"
+#include "TextureAtlas.hpp"
 
+#include <vector>
+#include <unordered_map>
 #include <cstdint>
+#include "SDL.h"
 
-struct SDL_Window;
-struct SDL_Texture;
-struct SDL_Renderer;
-
+class TileMap;
 class SdlTexture;
 typedef std::shared_ptr<SdlTexture> SdlTexturePtr;
 
@@ -30,6 +31,10 @@ public:
 
     static SdlTexturePtr loadTexture(ResourceManager& manager, SDL_Renderer* renderer, std::string filename);
 
+    // Create a transparent RGBA texture, to be filled a region at a time
+    static SdlTexturePtr createBlank(SDL_Renderer* renderer, int width, int height);
+    bool update(const SDL_Rect& rect, const void* pixels, int pitch);
+
 protected:
     static SDL_Texture* createTexture(SDL_Renderer* renderer, int width, int height, const void* data, int pitch, uint32_t format);
 
@@ -42,6 +47,45 @@ private:
 
 class SdlRenderer : public IRenderer
 {
+    // Region of a texture holding a sprite's image; either a whole texture or part of an atlas page
+    struct SpriteSource
+    {
+        SDL_Texture* texture = nullptr;
+        SDL_Rect rect;
+        float u0, v0, u1, v1;
+    };
+
+    // Sprite recorded for drawing when the batch is flushed
+    struct Sprite
+    {
+        SDL_Texture* texture;
+        SDL_Rect source;
+        SDL_Rect target;
+        float u0, v0, u1, v1;
+        SDL_Color color;
+        int run; // sprites may only be reordered within a run
+        int order; // index into m_runTextures
+    };
+
+    // Chunk of a TileMap pre-rendered into a target texture, at the tileset's resolution
+    struct TileChunk
+    {
+        SDL_Texture* texture = nullptr;
+        uint32_t stamp = 0, maskStamp = 0; // TileChunks stamps when last rendered
+    };
+
+    // Chunks cached for a TileMap; rebuilt whenever its size or tileset texture changes
+    struct TileCache
+    {
+        std::vector<TileChunk> chunks;
+        SDL_Texture* tileset = nullptr;
+        int cols = 0, rows = 0; // in chunks
+        int tileW = 0, tileH = 0; // in texels
+        int lastFrame = 0;
+    };
+
+    static constexpr const int TileCacheFrames = 60; // frames before the cache of an undrawn TileMap is released
+
     SDL_Window* m_window;
     SDL_Renderer* m_renderer;
     ResourceManager& m_resources;
@@ -50,8 +94,29 @@ class SdlRenderer : public IRenderer
     int m_width, m_height;
     struct {uint8_t r, g, b;} m_color;
 
+    std::vector<Sprite> m_sprites;
+    std::vector<SDL_Vertex> m_vertices;
+    std::vector<int> m_indices;
+    std::vector<uint8_t> m_corners; // scratch TileMask values at tile corners
+    std::vector<SDL_Texture*> m_runTextures; // textures in order of first use within the current run
+    int m_layer;
+    int m_run; // incremented whenever the layer or camera changes
+
+    std::vector<SdlTexture*> m_textures; // indexed by ResourceHandle; owned by m_resources
+    std::vector<SpriteSource> m_spriteSources; // indexed by ResourceHandle
+    std::vector<SdlTexturePtr> m_atlasPages;
+    TextureAtlas m_atlas;
+    std::unordered_map<const TileMap*, TileCache> m_tileCaches;
+    int m_frame;
+
+    // Counted per frame
+    SDL_Texture* m_boundTexture;
+    int m_drawCalls, m_textureSwitches;
+    int m_lastDrawCalls, m_lastTextureSwitches;
+
 public:
-    SdlRenderer(ResourceManager& resources): m_window(nullptr), m_renderer(nullptr), m_resources(resources) {}
+    SdlRenderer(ResourceManager& resources): m_window(nullptr), m_renderer(nullptr), m_resources(resources), m_layer(0), m_run(0), m_frame(0),
+        m_boundTexture(nullptr), m_drawCalls(0), m_textureSwitches(0), m_lastDrawCalls(0), m_lastTextureSwitches(0) {}
     ~SdlRenderer() override;
 
     bool init(int width, int height);
@@ -60,13 +125,33 @@ public:
     void postRender() override;
 
     void pushModelTransform(Transform& transform) override {m_model = transform;}
-    void pushCameraTransform(Transform& transform) override {m_camera = transform;}
+    void pushCameraTransform(Transform& transform) override {m_camera = transform; nextRun();}
 
+    void setLayer(int layer) override {if (layer != m_layer) {m_layer = layer; nextRun();}}
     void setColor(float red, float green, float blue) override;
-    void drawSprite(const std::string& name) override;
+    void drawSprite(const ResourceHandle& handle) override;
     void drawTiles(const TileMap* tilemap) override;
-    void drawLines(const std::vector<float>& points) override;
+    void drawLines(const float* points, size_t count) override;
 
     void popModelTransform() override {}
     void popCameraTransform() override {}
+
+    // Draw calls and texture changes made during the last frame
+    int getDrawCalls() const {return m_lastDrawCalls;}
+    int getTextureSwitches() const {return m_lastTextureSwitches;}
+
+    // Release all cached TileMap chunks, e.g. when the contents of render targets are lost
+    void resetTileCaches();
+
+private:
+    SdlTexture* getTexture(const ResourceHandle& handle);
+    const SpriteSource* getSpriteSource(const ResourceHandle& handle);
+    void nextRun() {++m_run; m_runTextures.clear();}
+    void flushSprites();
+    void countDraw(SDL_Texture* texture);
+
+    void drawMaskedTiles(const TileMap* tilemap, SdlTexture* texture, int tileW, int tileH);
+    bool drawTileChunks(const TileMap* tilemap, SDL_Texture* texture, int tileW, int tileH);
+    void renderTileChunk(const TileMap* tilemap, SDL_Texture* texture, TileCache& cache, int cx, int cy);
+    static void releaseTileCache(TileCache& cache);
 };
@@ -17,6 +17,9 @@
 #include <cstring>
 #include <cstdio>
 #include <limits>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
 #include "lua.h"
 #include "lauxlib.h"
 #include "lualib.h"
@@ -77,10 +80,9 @@ bool Scene::load(const char *filename)
     assert(m_L == nullptr);
     m_L = luaL_newstate();
 
-    // Add Scene pointer to registry
-    lua_pushliteral(m_L, "Scene");
-    lua_pushlightuserdata(m_L, this);
-    lua_rawset(m_L, LUA_REGISTRYINDEX);
+    // Keep Scene pointer in the extra space of the state, so it is found without a registry lookup
+    // NOTE threads get a copy of the main thread's extra space when created
+    *reinterpret_cast<Scene**>(lua_getextraspace(m_L)) = this;
 
     // Load only selected libraries
     //luaL_openlibs(m_L);
@@ -184,6 +186,22 @@ bool Scene::load(const char *filename)
     lua_pushcfunction(m_L, scene_setPortraitHint);
     lua_rawset(m_L, -3);
 
+    lua_pushliteral(m_L, "setFixedStep");
+    lua_pushcfunction(m_L, scene_setFixedStep);
+    lua_rawset(m_L, -3);
+
+    lua_pushliteral(m_L, "setPipelined");
+    lua_pushcfunction(m_L, scene_setPipelined);
+    lua_rawset(m_L, -3);
+
+    lua_pushliteral(m_L, "setGcBudget");
+    lua_pushcfunction(m_L, scene_setGcBudget);
+    lua_rawset(m_L, -3);
+
+    lua_pushliteral(m_L, "getGcStats");
+    lua_pushcfunction(m_L, scene_getGcStats);
+    lua_rawset(m_L, -3);
+
     lua_pushliteral(m_L, "quit");
     lua_pushcfunction(m_L, scene_quit);
     lua_rawset(m_L, -3);
@@ -238,9 +256,9 @@ bool Scene::load(const char *filename)
     lua_newtable(m_L);
     lua_rawset(m_L, LUA_REGISTRYINDEX);
 
-    // ==== Create weak ref table for userdata lookup by pointer ====
-    lua_pushstring(m_L, WEAK_REFS);
-    lua_newtable(m_L);
+    // ==== Create weak ref table for userdata lookup by slot ====
+    // NOTE slots are allocated densely, so they stay in the array part, which the collector clears without hashing
+    lua_createtable(m_L, 1024, 0);
 
     // Use metatable to set weak values mode
     lua_createtable(m_L, 0, 1);
@@ -249,7 +267,15 @@ bool Scene::load(const char *filename)
     lua_rawset(m_L, -3);
     lua_setmetatable(m_L, -2);
 
-    lua_rawset(m_L, LUA_REGISTRYINDEX);
+    m_userdataRefs = luaL_ref(m_L, LUA_REGISTRYINDEX);
+
+    // ==== Keep interned callback names, so callbacks are looked up without hashing strings ====
+    m_callbackNames.resize(IUserdata::CallbackCount);
+    for (int i = 0; i < IUserdata::CallbackCount; ++i)
+    {
+        lua_pushstring(m_L, IUserdata::getCallbackName(i));
+        m_callbackNames[i] = luaL_ref(m_L, LUA_REGISTRYINDEX);
+    }
 
     // ==== Load the user script ====
     if (luaL_loadfile(m_L, filename) != 0)
@@ -264,9 +290,14 @@ bool Scene::load(const char *filename)
     lua_pushvalue(m_L, -2);
     lua_rawset(m_L, LUA_REGISTRYINDEX);
 
+    // Check the watchdog every 2000 instructions from now on; calls are timed by the watchdog's own thread
+    lua_sethook(m_L, hook_watchdog, LUA_MASKCOUNT, 2000);
+
+    m_watchdog.arm();
     setWatchdog(2000);
     int ret = lua_pcall(m_L, 0, 0, 0);
     clearWatchdog();
+    m_watchdog.disarm();
 
     if (ret != 0)
     {
@@ -275,54 +306,147 @@ bool Scene::load(const char *filename)
         return false;
     }
 
+//#define PUSH_TIMING
+#ifdef PUSH_TIMING
+    // Push every object left alive by the script, in slot order and then shuffled
+    // NOTE keep many objects alive to time it, e.g. with "actors = {} for i = 1, 100000 do actors[i] = Actor{} end"
+    {
+        using namespace std::chrono;
+        std::vector<IUserdata*> objects;
+        lua_rawgeti(m_L, LUA_REGISTRYINDEX, m_userdataRefs);
+        for (int ref = 1; ref <= m_userdataRefCount; ++ref)
+        {
+            lua_rawgeti(m_L, -1, ref);
+            if (IUserdata* object = IUserdata::testInterface(m_L, -1))
+                objects.push_back(object);
+            lua_pop(m_L, 1);
+        }
+        lua_pop(m_L, 1);
+
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            if (pass == 1)
+            {
+                uint32_t seed = 1;
+                for (size_t i = objects.size(); i > 1; --i)
+                {
+                    seed = seed * 1664525u + 1013904223u;
+                    std::swap(objects[i - 1], objects[seed % i]);
+                }
+            }
+
+            high_resolution_clock::time_point t1 = high_resolution_clock::now();
+            for (int i = 0; i < 20; ++i)
+            {
+                for (IUserdata* object : objects)
+                {
+                    object->pushUserdata(m_L);
+                    lua_pop(m_L, 1);
+                }
+            }
+            high_resolution_clock::time_point t2 = high_resolution_clock::now();
+            const int64_t nsec = duration_cast<nanoseconds>(t2 - t1).count();
+            fprintf(stderr, "pushed %lld userdata/sec %s, %d objects\n", (long long)(objects.size() * 20 * 1000000000.0 / std::max(nsec, int64_t(1))), pass == 0 ? "in slot order" : "shuffled", int(objects.size()));
+        }
+    }
+#endif
+
     return true;
 }
 
-void Scene::setWatchdog(int millis)
+void Scene::hook_watchdog(lua_State* L, lua_Debug* /*ar*/)
 {
-    using namespace std::chrono;
-    m_watchdog = steady_clock::now();
-    m_watchdogTotal = millis;
-    m_watchdogCount = 0;
-    lua_sethook(m_L, hook_watchdog, LUA_MASKCOUNT, 2000);
+    Watchdog& watchdog = checkScene(L)->m_watchdog;
+    if (watchdog.isExpired())
+        luaL_error(L, "watchdog reset after %d milliseconds", watchdog.getLimit());
 }
 
-void Scene::clearWatchdog()
+void Scene::advance(float elapsed)
 {
-    using namespace std::chrono;
-    lua_sethook(m_L, nullptr, 0, 0);
-
-    /*auto current = steady_clock::now();
-    auto elapsed = duration_cast<milliseconds>(current - m_watchdog);
-    if (elapsed.count() > 0)
-        fprintf(stderr, "watchdog woke %d times over %d ms\n", m_watchdogCount, int(elapsed.count()));*/
-}
+    if (m_fixedStep <= 0.f)
+    {
+        update(elapsed);
+        return;
+    }
 
-void Scene::hook_watchdog(lua_State* L, lua_Debug* /*ar*/)
-{
-    using namespace std::chrono;
-    Scene* scene = checkScene(L);
-    ++(scene->m_watchdogCount);
+    // Keep the watchdog armed across all steps of the frame
+    m_watchdog.arm();
 
-    //if (ar->event != LUA_HOOKCOUNT)
-    //    fprintf(stderr, "===watchdog with event %d===\n", ar->event);
+    // Step at a fixed rate, carrying the remainder over to the next frame
+    // NOTE capping steps keeps a hitch from making the following frames slower still; the game slows down instead
+    m_accumulator += elapsed;
+    for (int steps = 0; m_accumulator >= m_fixedStep && steps < m_maxSteps; ++steps)
+    {
+        update(m_fixedStep);
+        m_accumulator -= m_fixedStep;
+    }
 
-    auto current = steady_clock::now();
-    auto elapsed = duration_cast<milliseconds>(current - scene->m_watchdog);
+    if (m_accumulator >= m_fixedStep)
+        m_accumulator = std::fmod(m_accumulator, m_fixedStep);
 
-    if (elapsed.count() > scene->m_watchdogTotal)
-        luaL_error(L, "watchdog reset after %d milliseconds", scene->m_watchdogTotal);
+    m_alpha = m_accumulator / m_fixedStep;
+    m_watchdog.disarm();
 }
 
 void Scene::update(float delta)
 {
+    m_watchdog.arm();
+
     // order of update dispatch doesn't really matter; choose bottom to top
     auto end = m_canvases.end();
     for (auto it = m_canvases.begin(); it != end; ++it)
         (*it)->update(m_L, delta);
 
+    m_watchdog.disarm();
+
     // TODO: should we manually tell Lua to step, or wait for auto-collect?
-    lua_gc(m_L, LUA_GCSTEP, 0);
+    // NOTE with a budget set, the collector only runs in collectGarbage
+    if (m_gcBudget <= 0)
+        lua_gc(m_L, LUA_GCSTEP, 0);
+}
+
+void Scene::collectGarbage()
+{
+    if (m_gcBudget <= 0)
+        return;
+
+    using namespace std::chrono;
+    const auto start = steady_clock::now();
+
+    // Nothing is freed while the collector is stopped, so what the heap grew by is what was allocated
+    const int heap = getHeapSize();
+    const int allocated = std::max(heap - m_gcHeap, 0);
+    m_gcRate += (float(allocated) - m_gcRate) * 0.125f;
+    m_gcDebt += allocated;
+
+    // Pay the collector for what was allocated, as it would pay itself when running on its own
+    // NOTE steps are sized by the allocation rate, so the budget is checked a few times a frame whatever the rate
+    // NOTE the budget is ignored while the collector is too far behind, so memory stays bounded
+    const int stepSize = std::min(std::max(int(m_gcRate) / GcStepsPerFrame, 1), GcMaxStep);
+    const auto end = start + microseconds(m_gcBudget);
+    while (m_gcDebt > 0)
+    {
+        const int size = std::min(stepSize, m_gcDebt);
+        m_gcDebt -= size;
+
+        // At the end of a cycle the collector waits for the heap to grow before starting another
+        if (lua_gc(m_L, LUA_GCSTEP, size))
+        {
+            m_gcDebt = 0;
+            break;
+        }
+
+        if (steady_clock::now() >= end && m_gcDebt <= m_gcRate * GcMaxLag)
+            break;
+    }
+
+    m_gcHeap = getHeapSize();
+    m_gcPause = int(duration_cast<microseconds>(steady_clock::now() - start).count());
+}
+
+int Scene::getHeapSize() const
+{
+    return m_L ? lua_gc(m_L, LUA_GCCOUNT, 0) : 0;
 }
 
 void Scene::playAudio(IAudio* audio)
@@ -338,21 +462,33 @@ void Scene::render(IRenderer* renderer)
 {
     assert(renderer != nullptr);
 
-    // dispatch render calls from bottom to top
+    record(m_renderQueue);
+    m_renderQueue.submit(renderer);
+}
+
+void Scene::record(RenderQueue& queue)
+{
+    // record render calls from bottom to top
+    queue.clear();
     auto end = m_canvases.end();
     for (auto it = m_canvases.begin(); it != end; ++it)
-        (*it)->render(renderer);
+        (*it)->render(&queue, m_alpha);
+
+    // then group textures within each layer
+    queue.sort();
 }
 
 bool Scene::mouseEvent(MouseEvent& event)
 {
     // dispatch events from top to bottom
+    bool handled = false;
+    m_watchdog.arm();
     auto end = m_canvases.rend();
-    for (auto it = m_canvases.rbegin(); it != end; ++it)
-        if ((*it)->mouseEvent(m_L, event))
-            return true; // stop dispatching an event when an Actor claims it
+    for (auto it = m_canvases.rbegin(); it != end && !handled; ++it)
+        handled = (*it)->mouseEvent(m_L, event); // stop dispatching an event when an Actor claims it
 
-    return false;
+    m_watchdog.disarm();
+    return handled;
 }
 
 bool Scene::controlEvent(ControlEvent& event)
@@ -386,18 +522,56 @@ void Scene::resize(int width, int height)
         (*it)->resize(m_L, width, height);
 }
 
-Scene* Scene::checkScene(lua_State* L)
+void Scene::pushCallbackName(lua_State* L, int callback)
 {
-    // Get light userdata from registry
-    lua_pushliteral(L, "Scene");
-    lua_rawget(L, LUA_REGISTRYINDEX);
-    assert(lua_type(L, -1) == LUA_TLIGHTUSERDATA);
+    assert(callback >= 0 && callback < int(m_callbackNames.size()));
+    lua_rawgeti(L, LUA_REGISTRYINDEX, m_callbackNames[callback]);
+}
 
-    // Cast light userdata to Scene*
-    auto scene = reinterpret_cast<Scene*>(lua_touserdata(L, -1));
-    assert(scene != nullptr);
+int Scene::acquireUserdataRef(lua_State* L, int index)
+{
+    int ref;
+    if (!m_freeUserdataRefs.empty())
+    {
+        ref = m_freeUserdataRefs.back();
+        m_freeUserdataRefs.pop_back();
+    }
+    else
+        ref = ++m_userdataRefCount;
+
+    index = lua_absindex(L, index);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, m_userdataRefs);
+    lua_pushvalue(L, index);
+    lua_rawseti(L, -2, ref);
     lua_pop(L, 1);
 
+    return ref;
+}
+
+void Scene::releaseUserdataRef(lua_State* L, int ref)
+{
+    // NOTE the collector has usually cleared the slot already, unless the object is destroyed during lua_close
+    lua_rawgeti(L, LUA_REGISTRYINDEX, m_userdataRefs);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, ref);
+    lua_pop(L, 1);
+
+    m_freeUserdataRefs.push_back(ref);
+}
+
+void Scene::pushUserdataRef(lua_State* L, int ref)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, m_userdataRefs);
+    lua_rawgeti(L, -1, ref);
+    lua_remove(L, -2);
+}
+
+Scene* Scene::checkScene(lua_State* L)
+{
+    // Get Scene pointer from the extra space of the state
+    auto scene = *reinterpret_cast<Scene**>(lua_getextraspace(L));
+    assert(scene != nullptr);
+
     return scene;
 }
 
@@ -540,6 +714,14 @@ int Scene::scene_saveState(lua_State* L)
         lua_pop(L, 1);
     }
 
+    // Serialize pipelining, if set
+    if (scene->m_isPipelined)
+    {
+        lua_pushboolean(L, scene->m_isPipelined);
+        serializer.serializeSetter("setPipelined", L, {-1});
+        lua_pop(L, 1);
+    }
+
     serializer.print();
 
     return 0;
@@ -622,6 +804,57 @@ int Scene::scene_setPortraitHint(lua_State* L)
     return 0;
 }
 
+int Scene::scene_setFixedStep(lua_State* L)
+{
+    Scene* scene = Scene::checkScene(L);
+    const float step = static_cast<float>(luaL_checknumber(L, 1));
+    const int maxSteps = int(luaL_optinteger(L, 2, scene->m_maxSteps));
+    luaL_argcheck(L, step >= 0.f, 1, "must be non-negative (0 to update once per frame)\n");
+    luaL_argcheck(L, maxSteps >= 1, 2, "must be at least 1\n");
+
+    scene->m_fixedStep = step;
+    scene->m_maxSteps = maxSteps;
+    scene->m_accumulator = 0.f;
+    scene->m_alpha = 1.f;
+
+    return 0;
+}
+
+int Scene::scene_setPipelined(lua_State* L)
+{
+    Scene* scene = Scene::checkScene(L);
+    luaL_checktype(L, 1, LUA_TBOOLEAN);
+
+    scene->m_isPipelined = (lua_toboolean(L, 1) == 1);
+
+    return 0;
+}
+
+int Scene::scene_setGcBudget(lua_State* L)
+{
+    Scene* scene = Scene::checkScene(L);
+    const int budget = int(luaL_checkinteger(L, 1));
+    luaL_argcheck(L, budget >= 0, 1, "must be non-negative (0 to collect automatically)\n");
+
+    // Stop the collector from running by itself, within frames, while paced
+    lua_gc(L, budget > 0 ? LUA_GCSTOP : LUA_GCRESTART, 0);
+    scene->m_gcBudget = budget;
+    scene->m_gcHeap = scene->getHeapSize();
+    scene->m_gcDebt = 0;
+    scene->m_gcPause = 0;
+
+    return 0;
+}
+
+int Scene::scene_getGcStats(lua_State* L)
+{
+    Scene* scene = Scene::checkScene(L);
+
+    lua_pushinteger(L, scene->m_gcPause);
+    lua_pushinteger(L, scene->getHeapSize());
+    return 2;
+}
+
 int Scene::scene_quit(lua_State* L)
 {
     Scene* scene = Scene::checkScene(L);
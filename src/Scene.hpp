@@ -2,11 +2,13 @@
 
 #include "Event.hpp"
 #include "ResourceManager.hpp"
+#include "RenderQueue.hpp"
+#include "Watchdog.hpp"
 
 #include <vector>
 #include <memory>
 #include <functional>
-#include <chrono>
+#include <cstdint>
 
 class Canvas;
 class IRenderer;
@@ -21,23 +23,40 @@ class Scene
     typedef std::function<void (void)> QuitCallback;
     typedef std::function<bool (const char*)> RegisterControlCallback;
 
+    static constexpr const int GcStepsPerFrame = 4; // collection steps per frame's worth of allocation, so the budget is checked as often
+    static constexpr const int GcMaxStep = 16; // KB stepped at most between checks of the budget
+    static constexpr const int GcMaxLag = 4; // frames' worth of allocation the collector may fall behind before the budget is ignored
+
     ResourceManager& m_resources;
     std::vector<Canvas*> m_canvases;
     std::vector<std::string> m_tempAudioList; // TODO replace with list of AudioSources
     QuitCallback m_quitCallback;
     RegisterControlCallback m_registerControlCallback;
     lua_State* m_L;
-    std::chrono::steady_clock::time_point m_watchdog;
-    int m_watchdogTotal;
-    int m_watchdogCount;
+    std::vector<int> m_callbackNames; // registry refs to interned IUserdata callback names, indexed by IUserdata::Callback
+    int m_userdataRefs; // registry ref to the weak table holding the userdata of each IUserdata in slots
+    int m_userdataRefCount; // slots ever used
+    std::vector<int> m_freeUserdataRefs; // slots released by destroyed objects, to be reused
+    uint32_t m_tagVersion; // changed whenever any object's tag member is set
+    Watchdog m_watchdog; // times script calls; armed while the scene is running scripts
+    int m_gcBudget; // microseconds of garbage collection after each frame, or 0 to collect automatically
+    int m_gcHeap; // KB in use after the last collection steps
+    int m_gcDebt; // KB allocated but not yet stepped through, carried over when the budget runs out
+    float m_gcRate; // KB allocated per frame, smoothed
+    int m_gcPause; // microseconds spent collecting after the last frame
+    float m_fixedStep; // length of each update when stepping at a fixed rate, or 0 to update once per frame
+    int m_maxSteps; // most fixed steps per frame; time beyond is dropped
+    float m_accumulator; // time not yet stepped
+    float m_alpha; // how far rendering is between the last two steps
+    RenderQueue m_renderQueue; // render calls of the last frame
     bool m_isPortraitHint;
+    bool m_isPipelined; // render on a thread of its own, a frame behind simulation
 
 public:
     static constexpr const char* const CANVASES = "CANVASES";
-    static constexpr const char* const WEAK_REFS = "WEAK_REFS";
     static constexpr const char* const GLOBAL_CHUNK = "GLOBAL_CHUNK";
 
-    Scene(ResourceManager& resources): m_resources(resources), m_L(nullptr), m_isPortraitHint(false) {}
+    Scene(ResourceManager& resources): m_resources(resources), m_L(nullptr), m_userdataRefs(0), m_userdataRefCount(0), m_tagVersion(0), m_gcBudget(0), m_gcHeap(0), m_gcDebt(0), m_gcRate(0.f), m_gcPause(0), m_fixedStep(0.f), m_maxSteps(4), m_accumulator(0.f), m_alpha(1.f), m_isPortraitHint(false), m_isPipelined(false) {}
     ~Scene();
 
     bool load(const char *filename);
@@ -45,18 +64,43 @@ public:
     void setRegisterControlCallback(RegisterControlCallback cb) {m_registerControlCallback = cb;}
 
     bool isPortraitHint() {return m_isPortraitHint;}
+    bool isPipelined() {return m_isPipelined;}
 
     ResourceManager& getResourceManager() {return m_resources;}
 
+    // Update by elapsed wall clock time, in fixed steps if set
+    void advance(float elapsed);
     void update(float delta);
     void playAudio(IAudio* audio);
     void render(IRenderer* renderer);
+    void record(RenderQueue& queue); // NOTE the queue still refers to TileMaps in the scene until detached
+    const RenderQueue& getRenderQueue() const {return m_renderQueue;}
     bool mouseEvent(MouseEvent& event);
     bool controlEvent(ControlEvent& event);
     void resize(int width, int height);
 
-    void setWatchdog(int millis);
-    void clearWatchdog();
+    // Step the garbage collector for up to the budget set by script, in the idle time after a frame
+    // NOTE does nothing unless a budget is set; the collector then only runs here
+    void collectGarbage();
+    int getGcPause() const {return m_gcPause;} // microseconds spent collecting after the last frame
+    int getHeapSize() const; // KB
+
+    // Limit the script call about to be made to millis, reporting an error if it runs longer
+    // NOTE only checked while the scene is updating, dispatching mouse events or loading
+    void setWatchdog(int millis) {m_watchdog.begin(millis);}
+    void clearWatchdog() {m_watchdog.end();}
+
+    void pushCallbackName(lua_State* L, int callback);
+
+    // NOTE Canvas systems match Actors by tag, so they compare versions to find out when to match again
+    void touchTags() {++m_tagVersion;}
+    uint32_t getTagVersion() const {return m_tagVersion;}
+
+    // Keep the userdata at index in a slot of a weak table, so it can be pushed by slot instead of looked up by pointer
+    // NOTE slots are freed when their objects are destroyed, never by the table itself
+    int acquireUserdataRef(lua_State* L, int index);
+    void releaseUserdataRef(lua_State* L, int ref);
+    void pushUserdataRef(lua_State* L, int ref);
 
     static Scene* checkScene(lua_State* L);
 
@@ -73,5 +117,9 @@ private:
     static int scene_playSample(lua_State* L); // TODO remove
     static int scene_registerControl(lua_State* L);
     static int scene_setPortraitHint(lua_State* L);
+    static int scene_setFixedStep(lua_State* L);
+    static int scene_setPipelined(lua_State* L);
+    static int scene_setGcBudget(lua_State* L);
+    static int scene_getGcStats(lua_State* L);
     static int scene_quit(lua_State* L);
 };
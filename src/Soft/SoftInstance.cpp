@@ -0,0 +1,97 @@
+#include "SoftInstance.hpp"
+
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+// Read an integer setting from the environment, or use the default if it isn't set
+static int getSetting(const char* name, int value)
+{
+    const char* text = getenv(name);
+    return text ? atoi(text) : value;
+}
+
+void SoftInstance::run(const char* script)
+{
+    SoftInstance instance;
+
+    if (!instance.init(script))
+        return;
+
+    // Step at a fixed rate, so every run of a script draws the same frames
+    const int frames = getSetting("SOFT_FRAMES", 600);
+    const float step = 1.f / 60.f;
+
+    double renderTime = 0.0;
+    int64_t gcTime = 0;
+    int gcMaxPause = 0;
+    int frame = 0;
+    for (; frame < frames && !instance.isQuit(); ++frame)
+    {
+        instance.update(step);
+
+        const auto start = std::chrono::steady_clock::now();
+        instance.render();
+        renderTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        instance.m_scene->collectGarbage();
+        gcTime += instance.m_scene->getGcPause();
+        gcMaxPause = std::max(gcMaxPause, instance.m_scene->getGcPause());
+    }
+
+    fprintf(stderr, "Rendered %d frames, %.3f ms per frame\n", frame, frame > 0 ? renderTime / frame : 0.0);
+    fprintf(stderr, "Lua heap %d KB, GC %.3f ms per frame (%.3f ms at most)\n", instance.m_scene->getHeapSize(),
+        frame > 0 ? gcTime / 1000.0 / frame : 0.0, gcMaxPause / 1000.0);
+
+    // Write the last frame, e.g. to compare against a known good image
+    const char* output = getenv("SOFT_OUTPUT");
+    if (output)
+        instance.m_renderer->saveImage(output);
+}
+
+bool SoftInstance::init(const char* script)
+{
+    m_scene = ScenePtr(new Scene(m_resources));
+    m_scene->setQuitCallback([&] {m_bQuit = true;});
+    m_scene->setRegisterControlCallback([&](const char* /*action*/)->bool
+    {
+        // NOTE there is no input, so no controls are bound
+        return false;
+    });
+
+    if (!m_scene->load(script))
+        return false;
+
+    // Same default sizes as SdlInstance
+    int width = getSetting("SOFT_WIDTH", m_scene->isPortraitHint() ? 600 : 800);
+    int height = getSetting("SOFT_HEIGHT", m_scene->isPortraitHint() ? 800 : 600);
+
+    m_renderer = SoftRendererPtr(new SoftRenderer(m_resources));
+    if (!m_renderer->init(width, height, getSetting("SOFT_THREADS", 1)))
+    {
+        m_renderer = nullptr;
+        return false;
+    }
+
+    m_scene->resize(width, height);
+
+    return true;
+}
+
+void SoftInstance::update(float elapsedTime)
+{
+    if (isQuit())
+        return;
+
+    // Send elapsed time down to game objects
+    m_scene->advance(elapsedTime);
+}
+
+void SoftInstance::render()
+{
+    m_renderer->preRender();
+    m_scene->render(m_renderer.get());
+    m_renderer->postRender();
+}
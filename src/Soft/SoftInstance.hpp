@@ -0,0 +1,34 @@
+#pragma once
+
+#include "SoftRenderer.hpp"
+#include "ResourceManager.hpp"
+#include "Scene.hpp"
+
+#include <memory>
+
+// Runs a script without a window, stepping a fixed number of frames and drawing each with SoftRenderer
+// NOTE set up through environment variables, see readme
+class SoftInstance
+{
+    typedef std::unique_ptr<SoftRenderer> SoftRendererPtr;
+    typedef std::unique_ptr<Scene> ScenePtr;
+
+    ResourceManager m_resources;
+    SoftRendererPtr m_renderer;
+    ScenePtr m_scene;
+    bool m_bQuit;
+
+public:
+    ~SoftInstance() {}
+
+    static void run(const char* script);
+
+private:
+    SoftInstance(): m_bQuit(false) {}
+
+    bool init(const char* script);
+    void update(float elapsedTime);
+    void render();
+
+    bool isQuit() const {return m_bQuit;}
+};
@@ -0,0 +1,504 @@
+#include "SoftRenderer.hpp"
+#include "TileMap.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <cmath>
+#include <cctype>
+#include <cstdio>
+#include <cassert>
+
+bool SoftRenderer::init(int width, int height, int threads)
+{
+    if (width <= 0 || height <= 0)
+    {
+        fprintf(stderr, "Invalid framebuffer size %dx%d\n", width, height);
+        return false;
+    }
+
+    m_width = width;
+    m_height = height;
+    m_pixels.resize(size_t(width) * height * 4);
+
+    const int count = WorkerPool::getThreadCount(std::max(threads, 0));
+    if (count > 1)
+        m_workers.reset(new WorkerPool(count));
+    else
+        m_workers.reset();
+
+    return true;
+}
+
+void SoftRenderer::preRender()
+{
+    // Clear to opaque black
+    for (size_t i = 0; i < m_pixels.size(); i += 4)
+    {
+        m_pixels[i] = m_pixels[i + 1] = m_pixels[i + 2] = 0;
+        m_pixels[i + 3] = 255;
+    }
+}
+
+void SoftRenderer::setColor(float red, float green, float blue)
+{
+    // Convert/cast to 8-bit int
+    m_color.r = uint8_t(std::min(std::max(red * 255.f, 0.f), 255.f));
+    m_color.g = uint8_t(std::min(std::max(green * 255.f, 0.f), 255.f));
+    m_color.b = uint8_t(std::min(std::max(blue * 255.f, 0.f), 255.f));
+}
+
+SoftTexture* SoftRenderer::getTexture(const ResourceHandle& handle)
+{
+    assert(handle.isValid());
+    if (handle.getIndex() >= int(m_textures.size()))
+        m_textures.resize(ResourceHandle::getCount(), nullptr);
+
+    // Load the texture resource the first time the handle is used
+    // NOTE the resource manager keeps the texture alive, so only the pointer is kept here
+    SoftTexture*& texture = m_textures[handle.getIndex()];
+    if (!texture)
+        texture = SoftTexture::loadTexture(m_resources, handle.getName()).get();
+
+    return texture;
+}
+
+void SoftRenderer::drawSprite(const ResourceHandle& handle)
+{
+    const SoftTexture* texture = getTexture(handle);
+    if (!texture)
+        return;
+
+    // Set the destination rect where we will draw the texture
+    const float scaleW = m_width / m_camera.getScaleX();
+    const float scaleH = m_height / m_camera.getScaleY();
+    Rect target;
+    target.w = int(ceil(m_model.getScaleX() * scaleW));
+    target.h = int(ceil(m_model.getScaleY() * scaleH));
+    target.x = int(floor((m_model.getX() - m_camera.getX()) * scaleW));
+    target.y = int(floor((m_model.getY() - m_camera.getY()) * scaleH));
+
+    const Rect source = {0, 0, texture->getWidth(), texture->getHeight()};
+    drawRect(texture, source, target, m_color, 0, m_height);
+}
+
+void SoftRenderer::drawTiles(const TileMap* tilemap)
+{
+    assert(tilemap != nullptr);
+    const TileSet* tileset = tilemap->getTileSet();
+    if (!tileset)
+        return;
+
+    const SoftTexture* texture = getTexture(tileset->getTexture());
+    if (!texture)
+        return;
+
+    // Masks are sampled at tile corners up front, as bands of rows share them
+    const TileMask* tileMask = tilemap->getTileMask();
+    if (tileMask)
+    {
+        getVisibleTiles(m_model, m_camera, tilemap->getCols(), tilemap->getRows(), m_cornerLeft, m_cornerTop, m_cornerRight, m_cornerBottom);
+        tileMask->getCorners(m_cornerLeft, m_cornerTop, m_cornerRight, m_cornerBottom, m_corners);
+    }
+
+    if (!m_workers)
+    {
+        drawTileRows(tilemap, texture, 0, m_height);
+        return;
+    }
+
+    // Split the framebuffer into bands of rows, each drawing every tile that overlaps it
+    // NOTE tiles are drawn in the same order within every band, so the result doesn't depend on the thread count
+    const int bands = (m_height + BandHeight - 1) / BandHeight;
+    m_workers->run(bands, [&](int band)
+    {
+        drawTileRows(tilemap, texture, band * BandHeight, std::min((band + 1) * BandHeight, m_height));
+    });
+}
+
+void SoftRenderer::drawTileRows(const TileMap* tilemap, const SoftTexture* texture, int first, int last)
+{
+    const TileSet* tileset = tilemap->getTileSet();
+    const TileMask* tileMask = tilemap->getTileMask();
+
+    // Set the source rect from which we will draw the texture
+    Rect source;
+    source.w = texture->getWidth() / tileset->getCols();
+    source.h = texture->getHeight() / tileset->getRows();
+
+    // Compute the scale from camera to screen
+    const float scaleW = m_width / m_camera.getScaleX();
+    const float scaleH = m_height / m_camera.getScaleY();
+
+    // Compute the scale from index to tile (i.e. the size in pixels as float)
+    const float floatW = m_model.getScaleX() * scaleW;
+    const float floatH = m_model.getScaleY() * scaleH;
+
+    // Use the top-left corner of the tilemap as the origin
+    const float originX = (m_model.getX() - m_camera.getX()) * scaleW;
+    const float originY = (m_model.getY() - m_camera.getY()) * scaleH;
+
+    // Set the destination rect where we will draw the texture
+    Rect target;
+    target.w = int(ceil(floatW));
+    target.h = int(ceil(floatH));
+
+    // Only iterate over tile (x, y) indices in view
+    int left, top, right, bottom;
+    getVisibleTiles(m_model, m_camera, tilemap->getCols(), tilemap->getRows(), left, top, right, bottom);
+
+    float yf = originY + top * floatH;
+    for (int y = top; y < bottom; ++y, yf += floatH)
+    {
+        // Skip rows of tiles outside the band
+        target.y = int(yf);
+        if (target.y >= last || target.y + target.h <= first)
+            continue;
+
+        float xf = originX + left * floatW;
+        for (int x = left; x < right; ++x, xf += floatW)
+        {
+            // Skip if tile index invalid (blank tile)
+            const int tile = tilemap->getIndex(x, y);
+            if (!tileset->isValidIndex(tile))
+                continue;
+
+            // Index tiles from top-left
+            source.x = tileset->getIndexCol(tile) * source.w;
+            source.y = tileset->getIndexRow(tile) * source.h;
+            target.x = int(xf);
+
+            if (!tileMask)
+            {
+                drawRect(texture, source, target, m_color, first, last);
+                continue;
+            }
+
+            // Shade by the mask at each corner, as SdlRenderer does; skip tiles that are dark at every corner
+            const int pitch = m_cornerRight - m_cornerLeft + 1;
+            const uint8_t* corner = &m_corners[(y - m_cornerTop) * pitch + x - m_cornerLeft];
+            const uint8_t masks[4] = {corner[0], corner[1], corner[pitch + 1], corner[pitch]};
+            if (masks[0] | masks[1] | masks[2] | masks[3])
+                drawRect(texture, source, target, m_color, first, last, masks);
+        }
+    }
+}
+
+void SoftRenderer::drawRect(const SoftTexture* texture, const Rect& source, const Rect& target, Color color, int first, int last, const uint8_t* masks)
+{
+    // Clip to the framebuffer and to rows first to last
+    const int left = std::max(target.x, 0);
+    const int right = std::min(target.x + target.w, m_width);
+    const int top = std::max(target.y, std::max(first, 0));
+    const int bottom = std::min(target.y + target.h, std::min(last, m_height));
+    if (left >= right || top >= bottom || source.w <= 0 || source.h <= 0)
+        return;
+
+    const uint8_t* texels = texture->getPixels();
+    const int pitch = texture->getWidth() * 4;
+    for (int y = top; y < bottom; ++y)
+    {
+        // Sample the nearest texel
+        const uint8_t* row = texels + (source.y + (y - target.y) * source.h / target.h) * pitch;
+        uint8_t* pixel = &m_pixels[(size_t(y) * m_width + left) * 4];
+        const float fy = (y - target.y + 0.5f) / target.h;
+        for (int x = left; x < right; ++x, pixel += 4)
+        {
+            const uint8_t* texel = row + (source.x + (x - target.x) * source.w / target.w) * 4;
+            const int alpha = texel[3];
+            if (alpha == 0)
+                continue;
+
+            // Interpolate the mask between corners (top-left, top-right, bottom-right, bottom-left)
+            if (masks)
+            {
+                const float fx = (x - target.x + 0.5f) / target.w;
+                const float upper = masks[0] + (masks[1] - masks[0]) * fx;
+                const float lower = masks[3] + (masks[2] - masks[3]) * fx;
+                const int mask = int(upper + (lower - upper) * fy + 0.5f);
+                color.r = uint8_t(m_color.r * mask / 255);
+                color.g = uint8_t(m_color.g * mask / 255);
+                color.b = uint8_t(m_color.b * mask / 255);
+            }
+
+            // Blend the modulated texel over the framebuffer
+            pixel[0] = uint8_t((texel[0] * color.r / 255 * alpha + pixel[0] * (255 - alpha)) / 255);
+            pixel[1] = uint8_t((texel[1] * color.g / 255 * alpha + pixel[1] * (255 - alpha)) / 255);
+            pixel[2] = uint8_t((texel[2] * color.b / 255 * alpha + pixel[2] * (255 - alpha)) / 255);
+        }
+    }
+}
+
+// Same color scale as SdlRenderer uses for debug lines
+inline void mapColorScale(float step, uint8_t& r, uint8_t& g, uint8_t& b)
+{
+    if (step < 1.f)
+        r = 255, g = uint8_t(255*step), b = 0;
+    else if (step < 2.f)
+        r = uint8_t(255*(2.f-step)), g = 255, b = 0;
+    else if (step < 3.f)
+        r = 0, g = 255, b = uint8_t(255*(step-2.f));
+    else if (step < 4.f)
+        r = 0, g = uint8_t(255*(4.f-step)), b = 255;
+    else if (step < 5.f)
+        r = uint8_t(255*(step-4.f)), g = 0, b = 255;
+    else
+        r = 255, g = 0, b = 255;
+}
+
+void SoftRenderer::drawLines(const float* points, size_t count)
+{
+    if (count == 0)
+        return;
+
+    const float scaleW = m_width / m_camera.getScaleX();
+    const float scaleH = m_height / m_camera.getScaleY();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        int segments = int(points[i]);
+
+        assert(segments >= 2);
+        assert(i + segments * 2 < count);
+
+        int lastX = int(floor((points[++i] - m_camera.getX()) * scaleW));
+        int lastY = int(floor((points[++i] - m_camera.getY()) * scaleH));
+
+        float stepSize = 5.f / (segments-1);
+        float step = 0.f;
+
+        while (segments-- >= 2)
+        {
+            int thisX = int(floor((points[++i] - m_camera.getX()) * scaleW));
+            int thisY = int(floor((points[++i] - m_camera.getY()) * scaleH));
+            Color color;
+            mapColorScale(step, color.r, color.g, color.b); step += stepSize;
+            drawLine(lastX, lastY, thisX, thisY, color);
+            lastX = thisX;
+            lastY = thisY;
+        }
+    }
+}
+
+void SoftRenderer::drawLine(int x0, int y0, int x1, int y1, Color color)
+{
+    // Bresenham's line, including both end points
+    const int dx = std::abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+    const int dy = -std::abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+    for (int error = dx + dy;;)
+    {
+        if (x0 >= 0 && y0 >= 0 && x0 < m_width && y0 < m_height)
+        {
+            uint8_t* pixel = &m_pixels[(size_t(y0) * m_width + x0) * 4];
+            pixel[0] = color.r;
+            pixel[1] = color.g;
+            pixel[2] = color.b;
+        }
+
+        if (x0 == x1 && y0 == y1)
+            break;
+
+        const int error2 = error * 2;
+        if (error2 >= dy)
+        {
+            error += dy;
+            x0 += sx;
+        }
+        if (error2 <= dx)
+        {
+            error += dx;
+            y0 += sy;
+        }
+    }
+}
+
+bool SoftRenderer::saveImage(const std::string& filename) const
+{
+    std::vector<char> data;
+    const size_t index = filename.find_last_of('.');
+    std::string ext = index != std::string::npos ? filename.substr(index + 1) : "";
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) {return char(tolower(c));});
+    if (ext == "png")
+        encodePNG(data);
+    else if (ext == "tga")
+        encodeTGA(data);
+    else
+    {
+        fprintf(stderr, "Unsupported image format \"%s\"\n", filename.c_str());
+        return false;
+    }
+
+    std::fstream file;
+    file.open(filename, file.out | file.binary | file.trunc);
+    if (!file.is_open())
+    {
+        fprintf(stderr, "Unable to open file \"%s\"\n", filename.c_str());
+        return false;
+    }
+
+    file.write(data.data(), data.size());
+    return bool(file);
+}
+
+void SoftRenderer::encodeTGA(std::vector<char>& data) const
+{
+    // Uncompressed 32 bit true color, with the first row at the top; fields are little endian
+    const uint8_t header[18] = {0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        uint8_t(m_width), uint8_t(m_width >> 8), uint8_t(m_height), uint8_t(m_height >> 8), 32, 0x28};
+    data.assign(header, header + sizeof(header));
+
+    // Convert RGBA pixels to BGRA
+    data.reserve(data.size() + m_pixels.size());
+    for (size_t i = 0; i < m_pixels.size(); i += 4)
+    {
+        data.push_back(char(m_pixels[i + 2]));
+        data.push_back(char(m_pixels[i + 1]));
+        data.push_back(char(m_pixels[i]));
+        data.push_back(char(m_pixels[i + 3]));
+    }
+}
+
+static uint32_t crc32(const char* data, size_t size, uint32_t crc = 0)
+{
+    static uint32_t table[256] = {};
+    if (table[1] == 0)
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; ++bit)
+                value = value & 1 ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+            table[i] = value;
+        }
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+        crc = table[(crc ^ uint8_t(data[i])) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void appendBigEndian(std::vector<char>& data, uint32_t value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+        data.push_back(char(value >> shift));
+}
+
+static void appendChunk(std::vector<char>& data, const char* type, const std::vector<char>& body)
+{
+    appendBigEndian(data, uint32_t(body.size()));
+    const size_t start = data.size();
+    data.insert(data.end(), type, type + 4);
+    data.insert(data.end(), body.begin(), body.end());
+    appendBigEndian(data, crc32(&data[start], data.size() - start));
+}
+
+void SoftRenderer::encodePNG(std::vector<char>& data) const
+{
+    static const char signature[] = {char(0x89), 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    data.assign(signature, signature + sizeof(signature));
+
+    // 8 bit RGBA, not interlaced
+    std::vector<char> header;
+    appendBigEndian(header, uint32_t(m_width));
+    appendBigEndian(header, uint32_t(m_height));
+    const char format[] = {8, 6, 0, 0, 0};
+    header.insert(header.end(), format, format + sizeof(format));
+    appendChunk(data, "IHDR", header);
+
+    // Rows are each preceded by their filter type, none here
+    std::vector<char> rows;
+    const size_t pitch = size_t(m_width) * 4;
+    rows.reserve((pitch + 1) * m_height);
+    for (int y = 0; y < m_height; ++y)
+    {
+        rows.push_back(0);
+        const char* row = reinterpret_cast<const char*>(&m_pixels[y * pitch]);
+        rows.insert(rows.end(), row, row + pitch);
+    }
+
+    // NOTE stored without compression, which keeps this simple at the cost of file size
+    std::vector<char> stream = {0x78, 0x01};
+    const size_t MaxBlock = 0xFFFF;
+    for (size_t offset = 0; offset < rows.size() || offset == 0; offset += MaxBlock)
+    {
+        const size_t size = std::min(rows.size() - offset, MaxBlock);
+        const bool final = offset + size == rows.size();
+        stream.push_back(final ? 1 : 0);
+        stream.push_back(char(size));
+        stream.push_back(char(size >> 8));
+        stream.push_back(char(~size));
+        stream.push_back(char(~size >> 8));
+        stream.insert(stream.end(), rows.begin() + offset, rows.begin() + offset + size);
+    }
+
+    // Adler-32 checksum of the uncompressed data
+    uint32_t a = 1, b = 0;
+    for (char c : rows)
+    {
+        a = (a + uint8_t(c)) % 65521;
+        b = (b + a) % 65521;
+    }
+    appendBigEndian(stream, b << 16 | a);
+    appendChunk(data, "IDAT", stream);
+
+    appendChunk(data, "IEND", {});
+}
+
+// =============================================================================
+// SoftTexture
+// =============================================================================
+
+SoftTexturePtr SoftTexture::loadTexture(ResourceManager& manager, std::string filename)
+{
+    // Return the resource if it is cached
+    IResourcePtr resource = manager.getResource(filename);
+    SoftTexturePtr texture = std::dynamic_pointer_cast<SoftTexture>(resource);
+    if (texture)
+        return texture;
+
+    // Load the raw file data into memory
+    std::vector<char> data;
+    if (!manager.loadRawData(filename, data))
+    {
+        texture = getPlaceholder();
+        manager.bindResource(filename, texture);
+        return texture;
+    }
+
+    // Pass the raw data to the loader
+    texture = SoftTexturePtr(new SoftTexture());
+    if (!TextureAtlas::decodeTGA(data, texture->m_image))
+    {
+        fprintf(stderr, "Malformed data in file \"%s\"\n", filename.c_str());
+        texture = getPlaceholder();
+        manager.bindResource(filename, texture);
+        return texture;
+    }
+
+    // Cache the resource and return it
+    manager.bindResource(filename, texture);
+    return texture;
+}
+
+SoftTexturePtr SoftTexture::m_placeholder;
+
+SoftTexturePtr SoftTexture::getPlaceholder()
+{
+    if (m_placeholder)
+        return m_placeholder;
+
+    // Generate a checkered pattern for missing textures
+    m_placeholder = SoftTexturePtr(new SoftTexture());
+    TextureAtlas::Image& image = m_placeholder->m_image;
+    image.width = image.height = 4;
+    image.pixels.resize(4 * 4 * 4);
+    for (int i = 0; i < 16; ++i)
+    {
+        // Alternate coloring evens or odds each row
+        const uint8_t value = i % 2 != (i / 4) % 2 ? 255 : 0;
+        image.pixels[i * 4] = image.pixels[i * 4 + 1] = image.pixels[i * 4 + 2] = value;
+        image.pixels[i * 4 + 3] = 255;
+    }
+
+    return m_placeholder;
+}
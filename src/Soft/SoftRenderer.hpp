@@ -0,0 +1,105 @@
+#pragma once
+
+#include "IRenderer.hpp"
+#include "ResourceManager.hpp"
+#include "TextureAtlas.hpp"
+#include "WorkerPool.hpp"
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+class SoftTexture;
+typedef std::shared_ptr<SoftTexture> SoftTexturePtr;
+
+// Decoded image kept in memory, to be sampled on the CPU
+class SoftTexture : public IResource
+{
+    TextureAtlas::Image m_image;
+
+protected:
+    SoftTexture() = default;
+
+public:
+    ~SoftTexture() override {}
+
+    int getWidth() const {return m_image.width;}
+    int getHeight() const {return m_image.height;}
+    const uint8_t* getPixels() const {return m_image.pixels.data();} // NOTE 32 bit RGBA, first row at the top
+
+    static SoftTexturePtr loadTexture(ResourceManager& manager, std::string filename);
+
+private:
+    static SoftTexturePtr getPlaceholder();
+    static SoftTexturePtr m_placeholder;
+};
+
+// Draws into an RGBA framebuffer in memory, so scripts can be rendered without a window or GPU
+// NOTE rects are mapped to pixels as SdlRenderer does, with nearest texel sampling and alpha blending
+class SoftRenderer : public IRenderer
+{
+    struct Rect
+    {
+        int x, y, w, h;
+    };
+
+    struct Color
+    {
+        uint8_t r, g, b;
+    };
+
+    static constexpr const int BandHeight = 32; // framebuffer rows drawn by each task when drawing tiles in parallel
+
+    ResourceManager& m_resources;
+    Transform m_model;
+    Transform m_camera;
+    int m_width, m_height;
+    Color m_color;
+    std::vector<uint8_t> m_pixels; // 32 bit RGBA, first row at the top
+    std::vector<SoftTexture*> m_textures; // indexed by ResourceHandle; owned by m_resources
+    std::vector<uint8_t> m_corners; // TileMask values at the corners of tiles in view of the map being drawn
+    int m_cornerLeft, m_cornerTop, m_cornerRight, m_cornerBottom;
+    std::unique_ptr<WorkerPool> m_workers; // only when using more than one thread
+
+public:
+    SoftRenderer(ResourceManager& resources): m_resources(resources), m_width(0), m_height(0), m_color{255, 255, 255},
+        m_cornerLeft(0), m_cornerTop(0), m_cornerRight(0), m_cornerBottom(0) {}
+    ~SoftRenderer() override {}
+
+    // NOTE threads are used to draw tiles; 0 for one per core
+    bool init(int width, int height, int threads = 1);
+
+    void preRender() override;
+    void postRender() override {}
+
+    void pushModelTransform(Transform& transform) override {m_model = transform;}
+    void pushCameraTransform(Transform& transform) override {m_camera = transform;}
+
+    void setLayer(int /*layer*/) override {}
+    void setColor(float red, float green, float blue) override;
+    void drawSprite(const ResourceHandle& handle) override;
+    void drawTiles(const TileMap* tilemap) override;
+    void drawLines(const float* points, size_t count) override;
+
+    void popModelTransform() override {}
+    void popCameraTransform() override {}
+
+    int getWidth() const {return m_width;}
+    int getHeight() const {return m_height;}
+    const std::vector<uint8_t>& getPixels() const {return m_pixels;}
+
+    // Write the framebuffer to a PNG or TGA file, chosen by extension
+    bool saveImage(const std::string& filename) const;
+
+private:
+    SoftTexture* getTexture(const ResourceHandle& handle);
+
+    void drawTileRows(const TileMap* tilemap, const SoftTexture* texture, int first, int last);
+
+    // NOTE masks are the TileMask at each corner, top-left clockwise, or null to draw in a flat color
+    void drawRect(const SoftTexture* texture, const Rect& source, const Rect& target, Color color, int first, int last, const uint8_t* masks = nullptr);
+    void drawLine(int x0, int y0, int x1, int y1, Color color);
+
+    void encodeTGA(std::vector<char>& data) const;
+    void encodePNG(std::vector<char>& data) const;
+};
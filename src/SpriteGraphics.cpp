@@ -13,17 +13,19 @@ void SpriteGraphics::render(IRenderer* renderer)
         return;
 
     renderer->setColor(m_color.r, m_color.g, m_color.b);
-    renderer->drawSprite(m_filename);
+    renderer->drawSprite(m_sprite);
 }
 
 void SpriteGraphics::construct(lua_State* L)
 {
     getStringReq(L, 2, "sprite", m_filename);
+    m_sprite = ResourceHandle(m_filename);
 }
 
 void SpriteGraphics::clone(lua_State* /*L*/, SpriteGraphics* source)
 {
     m_filename = source->m_filename;
+    m_sprite = source->m_sprite;
 }
 
 void SpriteGraphics::serialize(lua_State* /*L*/, Serializer* serializer, ObjectRef* ref)
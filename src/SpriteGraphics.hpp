@@ -1,12 +1,14 @@
 #pragma once
 
 #include "IGraphics.hpp"
+#include "ResourceHandle.hpp"
 
 #include <string>
 
 class SpriteGraphics : public TUserdata<SpriteGraphics, IGraphics>
 {
     std::string m_filename;
+    ResourceHandle m_sprite; // resolved from m_filename
 
     SpriteGraphics() = default;
 
@@ -0,0 +1,212 @@
+#include "TextureAtlas.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <cstdio>
+
+bool TextureAtlas::pack(int width, int height, Rect& rect)
+{
+    if (width <= 0 || height <= 0 || width > MaxImageSize || height > MaxImageSize)
+        return false;
+
+    const int paddedW = width + Padding * 2;
+    const int paddedH = height + Padding * 2;
+
+    // Use the first page with room, or start a new one
+    int page = 0, index, y;
+    for (int count = int(m_pages.size()); page < count; ++page)
+    {
+        if (findPosition(m_pages[page], paddedW, paddedH, index, y))
+            break;
+    }
+
+    if (page == int(m_pages.size()))
+    {
+        m_pages.emplace_back();
+        m_pages.back().skyline.push_back({0, 0, PageSize});
+        findPosition(m_pages.back(), paddedW, paddedH, index, y);
+    }
+
+    const int x = m_pages[page].skyline[index].x;
+    insert(m_pages[page], index, paddedW, paddedH, y);
+    m_usedArea += int64_t(paddedW) * paddedH;
+
+    rect = {page, x + Padding, y + Padding, width, height};
+    return true;
+}
+
+float TextureAtlas::getOccupancy() const
+{
+    if (m_pages.empty())
+        return 0.f;
+
+    return float(double(m_usedArea) / (double(PageSize) * PageSize * m_pages.size()));
+}
+
+bool TextureAtlas::findPosition(const Page& page, int width, int height, int& index, int& y) const
+{
+    // Choose the position that keeps the skyline lowest, then the one wasting the least of the segment
+    int bestTop = std::numeric_limits<int>::max();
+    int bestWidth = std::numeric_limits<int>::max();
+    index = -1;
+
+    const auto& skyline = page.skyline;
+    for (int i = 0, count = int(skyline.size()); i < count; ++i)
+    {
+        if (skyline[i].x + width > PageSize)
+            break;
+
+        // Rest on the highest segment under the image
+        int top = 0;
+        for (int j = i, remaining = width; remaining > 0; ++j)
+        {
+            top = std::max(top, skyline[j].y);
+            remaining -= skyline[j].width;
+        }
+
+        if (top + height > PageSize)
+            continue;
+
+        if (top + height < bestTop || (top + height == bestTop && skyline[i].width < bestWidth))
+        {
+            bestTop = top + height;
+            bestWidth = skyline[i].width;
+            index = i;
+            y = top;
+        }
+    }
+
+    return index >= 0;
+}
+
+void TextureAtlas::insert(Page& page, int index, int width, int height, int y)
+{
+    auto& skyline = page.skyline;
+    const int x = skyline[index].x;
+    skyline.insert(skyline.begin() + index, {x, y + height, width});
+
+    // Trim the segments now under the image
+    for (int i = index + 1; i < int(skyline.size());)
+    {
+        const int overlap = x + width - skyline[i].x;
+        if (overlap <= 0)
+            break;
+
+        if (overlap < skyline[i].width)
+        {
+            skyline[i].x += overlap;
+            skyline[i].width -= overlap;
+            break;
+        }
+
+        skyline.erase(skyline.begin() + i);
+    }
+
+    // Merge neighbouring segments of the same height
+    for (int i = 0; i + 1 < int(skyline.size());)
+    {
+        if (skyline[i].y == skyline[i + 1].y)
+        {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + i + 1);
+        }
+        else
+            ++i;
+    }
+}
+
+void TextureAtlas::addPadding(const Image& image, Image& padded)
+{
+    padded.width = image.width + Padding * 2;
+    padded.height = image.height + Padding * 2;
+    padded.pixels.resize(padded.width * padded.height * 4);
+
+    // Copy each texel from the nearest texel of the image
+    for (int y = 0; y < padded.height; ++y)
+    {
+        const int sourceY = std::min(std::max(y - Padding, 0), image.height - 1);
+        for (int x = 0; x < padded.width; ++x)
+        {
+            const int sourceX = std::min(std::max(x - Padding, 0), image.width - 1);
+            memcpy(&padded.pixels[(y * padded.width + x) * 4], &image.pixels[(sourceY * image.width + sourceX) * 4], 4);
+        }
+    }
+}
+
+void TextureAtlas::flipRows(Image& image)
+{
+    const int pitch = image.width * 4;
+    for (int i = 0; i < image.height / 2; ++i)
+    {
+        auto low = image.pixels.begin() + pitch * i;
+        auto high = image.pixels.begin() + pitch * (image.height - i - 1);
+        std::swap_ranges(low, low + pitch, high);
+    }
+}
+
+bool TextureAtlas::decodeTGA(const std::vector<char>& data, Image& image)
+{
+    const int HeaderSize = 18;
+    if (data.size() < HeaderSize)
+    {
+        fprintf(stderr, "TGA file is smaller than header size\n");
+        return false;
+    }
+
+    // Parse TGA header; fields are little endian
+    auto byte = [&data](int i) {return int(uint8_t(data[i]));};
+    const int idLength = byte(0);
+    const int imageType = byte(2);
+    const int width = byte(12) | byte(13) << 8;
+    const int height = byte(14) | byte(15) << 8;
+    const int pixelDepth = byte(16);
+    const int descriptor = byte(17);
+
+    if (imageType != 2 || (pixelDepth != 16 && pixelDepth != 24 && pixelDepth != 32) || byte(1) != 0)
+    {
+        fprintf(stderr, "Unsupported TGA format\n");
+        return false;
+    }
+
+    const int bytesPerPixel = pixelDepth / 8;
+    const size_t offset = HeaderSize + idLength;
+    if (data.size() < offset + size_t(width) * height * bytesPerPixel)
+    {
+        fprintf(stderr, "TGA file is smaller than data size\n");
+        return false;
+    }
+
+    // Convert BGR(A) pixels to RGBA
+    // NOTE the alpha of 16 bit pixels is only used if the descriptor says there is an alpha bit
+    const bool hasAlpha = (descriptor & 0x0F) != 0;
+    image.width = width;
+    image.height = height;
+    image.pixels.resize(size_t(width) * height * 4);
+    const uint8_t* source = reinterpret_cast<const uint8_t*>(&data[offset]);
+    uint8_t* target = image.pixels.data();
+    for (int i = 0, count = width * height; i < count; ++i, source += bytesPerPixel, target += 4)
+    {
+        if (bytesPerPixel == 2)
+        {
+            const int value = source[0] | source[1] << 8;
+            target[0] = uint8_t(((value >> 10) & 0x1F) * 255 / 31);
+            target[1] = uint8_t(((value >> 5) & 0x1F) * 255 / 31);
+            target[2] = uint8_t((value & 0x1F) * 255 / 31);
+            target[3] = !hasAlpha || (value & 0x8000) ? 255 : 0;
+        }
+        else
+        {
+            target[0] = source[2];
+            target[1] = source[1];
+            target[2] = source[0];
+            target[3] = bytesPerPixel == 4 && hasAlpha ? source[3] : 255;
+        }
+    }
+
+    // Rows are stored from the bottom unless the descriptor says otherwise
+    if (!(descriptor & 0x20))
+        flipRows(image);
+
+    return true;
+}
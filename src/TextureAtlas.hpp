@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+// Packs small images into large square pages with a skyline packer, so sprites can share a texture
+// NOTE only positions are tracked here; renderers create the page textures and copy images into them
+class TextureAtlas
+{
+public:
+    static constexpr const int PageSize = 1024;
+    static constexpr const int MaxImageSize = 256; // larger images keep a texture of their own
+    static constexpr const int Padding = 1; // texels around each image, filled with its edges so filtering doesn't bleed
+
+    // NOTE x, y, width and height are of the image itself, inside its padding
+    struct Rect
+    {
+        int page;
+        int x, y, width, height;
+    };
+
+    // Decoded image, as 32 bit RGBA with the first row at the top
+    struct Image
+    {
+        int width = 0, height = 0;
+        std::vector<uint8_t> pixels;
+    };
+
+private:
+    // Top edge of the packed area over a span of columns; segments cover the page left to right
+    struct Segment
+    {
+        int x, y, width;
+    };
+
+    struct Page
+    {
+        std::vector<Segment> skyline;
+    };
+
+    std::vector<Page> m_pages;
+    int64_t m_usedArea = 0;
+
+public:
+    TextureAtlas() = default;
+    ~TextureAtlas() {}
+
+    // Find space for an image, adding a page if none has room; returns false if the image is too large to pack
+    bool pack(int width, int height, Rect& rect);
+
+    int getPageCount() const {return int(m_pages.size());}
+
+    // Get the fraction of the area of all pages taken by packed images and their padding
+    float getOccupancy() const;
+
+    // Get an image surrounded by copies of its edges, ready to be copied to a page at the rect less the padding
+    static void addPadding(const Image& image, Image& padded);
+    static void flipRows(Image& image);
+
+    static bool decodeTGA(const std::vector<char>& data, Image& image);
+
+private:
+    bool findPosition(const Page& page, int width, int height, int& index, int& y) const;
+    void insert(Page& page, int index, int width, int height, int y);
+};
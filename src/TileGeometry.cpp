@@ -0,0 +1,146 @@
+#include "TileGeometry.hpp"
+#include "TileMap.hpp"
+
+void TileGeometry::resize(int cols, int rows)
+{
+    const int oldRows = m_rows;
+    m_rows = rows;
+
+    // Start over if rows have changed width
+    if (cols != m_cols)
+    {
+        m_cols = cols;
+        m_bands.clear();
+        m_bands.resize((rows + BandRows - 1) / BandRows);
+        m_dirty = true;
+        return;
+    }
+
+    // Otherwise only the band holding the last of the old rows and any new bands change
+    m_bands.resize((rows + BandRows - 1) / BandRows);
+    invalidateRows(std::min(oldRows, rows) - 1, rows);
+    m_dirty = true;
+}
+
+void TileGeometry::invalidate()
+{
+    for (auto& band : m_bands)
+        band.dirty = true;
+    m_dirty = true;
+}
+
+void TileGeometry::invalidateRows(int top, int bottom)
+{
+    top = std::max(top, 0);
+    bottom = std::min(bottom, m_rows);
+    if (top >= bottom)
+        return;
+
+    for (int b = top / BandRows, last = (bottom - 1) / BandRows; b <= last; ++b)
+        m_bands[b].dirty = true;
+    m_dirty = true;
+}
+
+void TileGeometry::update(const TileMap& tilemap)
+{
+    if (!m_dirty)
+        return;
+
+    assert(tilemap.getCols() == m_cols && tilemap.getRows() == m_rows);
+    for (int b = 0, count = int(m_bands.size()); b < count; ++b)
+    {
+        if (m_bands[b].dirty)
+            buildBand(tilemap, b);
+    }
+
+    m_dirty = false;
+}
+
+void TileGeometry::buildBand(const TileMap& tilemap, int index)
+{
+    Band& band = m_bands[index];
+    band.rects.clear();
+    band.nodes.clear();
+    band.dirty = false;
+
+    if (!tilemap.getTileSet())
+        return;
+
+    const int top = index * BandRows;
+    const int bottom = std::min(m_rows, top + BandRows);
+    m_used.assign(m_cols * (bottom - top), false);
+
+    auto isFree = [&](int x, int y)
+    {
+        return !m_used[(y - top) * m_cols + x] && tilemap.isFlagSet(x, y, TileSet::MoveBlocking);
+    };
+
+    // Greedily merge blocking tiles into rectangles; first along the row, then down as far as the whole run is blocking
+    // NOTE rectangles never cross into another band, so bands can be rebuilt independently
+    for (int y = top; y < bottom; ++y)
+    {
+        for (int x = 0; x < m_cols; ++x)
+        {
+            if (!isFree(x, y))
+                continue;
+
+            int right = x + 1;
+            while (right < m_cols && isFree(right, y))
+                ++right;
+
+            int rectBottom = y + 1;
+            for (; rectBottom < bottom; ++rectBottom)
+            {
+                int i = x;
+                while (i < right && isFree(i, rectBottom))
+                    ++i;
+                if (i < right)
+                    break;
+            }
+
+            for (int j = y; j < rectBottom; ++j)
+                std::fill_n(m_used.begin() + ((j - top) * m_cols + x), right - x, true);
+
+            band.rects.push_back({x, y, right, rectBottom});
+            x = right - 1;
+        }
+    }
+
+    if (!band.rects.empty())
+        buildNodes(band, 0, int(band.rects.size()));
+}
+
+void TileGeometry::buildNodes(Band& band, int first, int last)
+{
+    // Get bounds of the range of rects
+    Rect bounds = band.rects[first];
+    for (int i = first + 1; i < last; ++i)
+    {
+        const Rect& rect = band.rects[i];
+        bounds.left = std::min(bounds.left, rect.left);
+        bounds.top = std::min(bounds.top, rect.top);
+        bounds.right = std::max(bounds.right, rect.right);
+        bounds.bottom = std::max(bounds.bottom, rect.bottom);
+    }
+
+    // NOTE node may move as children are added, so refer to it by index
+    const int index = int(band.nodes.size());
+    band.nodes.push_back({bounds, first, last - first, 0});
+
+    if (last - first > LeafRects)
+    {
+        // Split at the median along the longer axis
+        const int mid = (first + last) / 2;
+        auto begin = band.rects.begin();
+        if (bounds.right - bounds.left >= bounds.bottom - bounds.top)
+            std::nth_element(begin + first, begin + mid, begin + last, [](const Rect& a, const Rect& b) {return a.left + a.right < b.left + b.right;});
+        else
+            std::nth_element(begin + first, begin + mid, begin + last, [](const Rect& a, const Rect& b) {return a.top + a.bottom < b.top + b.bottom;});
+
+        band.nodes[index].count = 0;
+        buildNodes(band, first, mid);
+        buildNodes(band, mid, last);
+    }
+
+    band.nodes[index].skip = int(band.nodes.size());
+}
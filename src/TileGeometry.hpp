@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+class TileMap;
+
+// Blocking tiles of a TileMap greedily merged into rectangles, with a small BVH over each band of rows
+// NOTE bands are only rebuilt when queried, so many edits between queries cost a single rebuild
+class TileGeometry
+{
+public:
+    // NOTE in tile coordinates, with right and bottom exclusive
+    struct Rect
+    {
+        int left, top, right, bottom;
+
+        bool isOverlapping(int l, int t, int r, int b) const {return right > l && left < r && bottom > t && top < b;}
+    };
+
+    static constexpr const int BandRows = 16;
+    static constexpr const int LeafRects = 4;
+
+private:
+    struct Node
+    {
+        Rect bounds;
+        int first, count; // range of rects for a leaf; count is 0 for inner nodes
+        int skip; // next node to visit if bounds are not overlapping
+    };
+
+    struct Band
+    {
+        std::vector<Rect> rects;
+        std::vector<Node> nodes; // pre-order, so the first child immediately follows its parent
+        bool dirty = true;
+    };
+
+    std::vector<Band> m_bands;
+    std::vector<bool> m_used;
+    int m_cols = 0, m_rows = 0;
+    bool m_dirty = true;
+
+public:
+    TileGeometry() = default;
+    ~TileGeometry() {}
+
+    void resize(int cols, int rows);
+    void invalidate();
+    void invalidateRows(int top, int bottom);
+
+    // Rebuild any bands invalidated since the last update
+    void update(const TileMap& tilemap);
+
+    // Visit rects overlapping a range of tiles, until visit returns true
+    template <class T> bool query(int left, int top, int right, int bottom, T visit) const;
+
+private:
+    void buildBand(const TileMap& tilemap, int index);
+    void buildNodes(Band& band, int first, int last);
+};
+
+template <class T>
+bool TileGeometry::query(int left, int top, int right, int bottom, T visit) const
+{
+    assert(!m_dirty);
+
+    const int bandFirst = std::max(0, top) / BandRows;
+    const int bandLast = std::min(int(m_bands.size()), (std::min(m_rows, bottom) + BandRows - 1) / BandRows);
+    for (int b = bandFirst; b < bandLast; ++b)
+    {
+        const Band& band = m_bands[b];
+        const int count = int(band.nodes.size());
+        for (int i = 0; i < count;)
+        {
+            const Node& node = band.nodes[i];
+            if (!node.bounds.isOverlapping(left, top, right, bottom))
+            {
+                i = node.skip;
+                continue;
+            }
+
+            for (int r = node.first, end = node.first + node.count; r < end; ++r)
+            {
+                const Rect& rect = band.rects[r];
+                if (rect.isOverlapping(left, top, right, bottom) && visit(rect))
+                    return true;
+            }
+
+            ++i;
+        }
+    }
+
+    return false;
+}
@@ -1,6 +1,7 @@
 #include "TileMap.hpp"
 #include "Serializer.hpp"
 #include "ResourceManager.hpp"
+#include "Actor.hpp"
 
 #include <cstdlib>
 #include <chrono>
@@ -9,6 +10,42 @@ const luaL_Reg TileSet::METHODS[];
 const luaL_Reg TileMask::METHODS[];
 const luaL_Reg TileMap::METHODS[];
 
+// =============================================================================
+// TileChunks
+// =============================================================================
+
+uint32_t TileChunks::s_nextStamp = 0;
+
+void TileChunks::resize(int cols, int rows)
+{
+    m_cols = (cols + Size - 1) / Size;
+    m_rows = (rows + Size - 1) / Size;
+    m_stamps.resize(m_cols * m_rows);
+    invalidate();
+}
+
+void TileChunks::invalidate()
+{
+    for (auto& stamp : m_stamps)
+        stamp = ++s_nextStamp;
+}
+
+void TileChunks::invalidateRect(int x, int y, int w, int h)
+{
+    if (w <= 0 || h <= 0)
+        return;
+
+    const int left = std::max(x, 0) / Size;
+    const int top = std::max(y, 0) / Size;
+    const int right = std::min((x + w - 1) / Size, m_cols - 1);
+    const int bottom = std::min((y + h - 1) / Size, m_rows - 1);
+    for (int j = top; j <= bottom; ++j)
+    {
+        for (int i = left; i <= right; ++i)
+            m_stamps[j * m_cols + i] = ++s_nextStamp;
+    }
+}
+
 // =============================================================================
 // TileSet
 // =============================================================================
@@ -16,6 +53,7 @@ const luaL_Reg TileMap::METHODS[];
 void TileSet::construct(lua_State* L)
 {
     getStringReq(L, 2, "filename", m_filename);
+    m_texture = ResourceHandle(m_filename);
     getListReq(L, 2, "size", m_cols, m_rows);
     m_flags.resize(m_cols * m_rows);
     getVectorOpt(L, 2, "data", m_flags);
@@ -24,6 +62,7 @@ void TileSet::construct(lua_State* L)
 void TileSet::clone(lua_State* /*L*/, TileSet* source)
 {
     m_filename = source->m_filename;
+    m_texture = source->m_texture;
     m_flags = source->m_flags;
     m_cols = source->m_cols;
     m_rows = source->m_rows;
@@ -55,6 +94,7 @@ void TileMask::construct(lua_State* L)
     getListReq(L, 2, "size", m_cols, m_rows);
     m_mask.resize(m_cols * m_rows);
     getVectorOpt(L, 2, "data", m_mask);
+    m_chunks.resize(m_cols, m_rows);
 }
 
 void TileMask::clone(lua_State* /*L*/, TileMask* source)
@@ -62,6 +102,7 @@ void TileMask::clone(lua_State* /*L*/, TileMask* source)
     m_mask = source->m_mask;
     m_cols = source->m_cols;
     m_rows = source->m_rows;
+    m_chunks.resize(m_cols, m_rows);
 }
 
 void TileMask::serialize(lua_State* /*L*/, Serializer* serializer, ObjectRef* ref)
@@ -70,6 +111,28 @@ void TileMask::serialize(lua_State* /*L*/, Serializer* serializer, ObjectRef* re
     serializer->setVector(ref, "", "data", m_mask);
 }
 
+void TileMask::getCorners(int left, int top, int right, int bottom, std::vector<uint8_t>& corners) const
+{
+    corners.clear();
+    for (int y = top; y <= bottom; ++y)
+    {
+        for (int x = left; x <= right; ++x)
+        {
+            // Average the (up to) four tiles around the corner, ignoring those off the edge
+            int sum = 0, count = 0;
+            for (int j = std::max(y - 1, 0); j <= std::min(y, m_rows - 1); ++j)
+            {
+                for (int i = std::max(x - 1, 0); i <= std::min(x, m_cols - 1); ++i)
+                {
+                    sum += getMask(i, j);
+                    ++count;
+                }
+            }
+            corners.push_back(count ? uint8_t(sum / count) : 0);
+        }
+    }
+}
+
 int TileMask::script_getMask(lua_State* L)
 {
     TileMask* tileMask = TileMask::checkUserdata(L, 1);
@@ -115,6 +178,7 @@ int TileMask::script_fillCircle(lua_State* L)
     const int xhb = std::min(x + radius, cols - 1);
 
     // Fill the outside of the circle
+    // NOTE this invalidates every chunk
     tileMask->fillMask(outside);
 
     // Fill the inside of the circle
@@ -149,6 +213,7 @@ int TileMask::script_clampMask(lua_State* L)
             tileMask->setMask(x, y, mask);
         }
     }
+    tileMask->m_chunks.invalidate();
 
     return 0;
 }
@@ -190,6 +255,8 @@ void TileMap::construct(lua_State* L)
     getListReq(L, 2, "size", m_cols, m_rows);
     m_map.resize(m_cols * m_rows);
     getVectorOpt(L, 2, "data", m_map);
+    m_geometry.resize(m_cols, m_rows);
+    m_chunks.resize(m_cols, m_rows);
 }
 
 void TileMap::clone(lua_State* L, TileMap* source)
@@ -200,6 +267,52 @@ void TileMap::clone(lua_State* L, TileMap* source)
     m_map = source->m_map;
     m_cols = source->m_cols;
     m_rows = source->m_rows;
+    m_geometry.resize(m_cols, m_rows);
+    m_chunks.resize(m_cols, m_rows);
+}
+
+void TileMap::destroy(lua_State* /*L*/)
+{
+    // Components outliving the map drop it, so they don't unlink from it later
+    for (const auto& user : m_users)
+        *user.tilemap = nullptr;
+    m_users.clear();
+}
+
+void TileMap::link(TileMap* previous, Actor* const* actor, TileMap** tilemap)
+{
+    if (previous == *tilemap)
+        return;
+
+    if (previous)
+        previous->removeUser(tilemap);
+    if (*tilemap)
+        (*tilemap)->m_users.push_back({actor, tilemap});
+}
+
+void TileMap::unlink(TileMap** tilemap)
+{
+    if (*tilemap)
+        (*tilemap)->removeUser(tilemap);
+}
+
+void TileMap::removeUser(TileMap** tilemap)
+{
+    auto it = std::find_if(m_users.begin(), m_users.end(), [tilemap](const User& user) {return user.tilemap == tilemap;});
+    assert(it != m_users.end());
+    *it = m_users.back();
+    m_users.pop_back();
+}
+
+void TileMap::touchUsers()
+{
+    // Bounds and predicted collisions of the Actors drawing or colliding with the map are out of date
+    // NOTE touching also makes the Canvas predict collisions again for the rest of a frame, when edited from a callback
+    for (const auto& user : m_users)
+    {
+        if (*user.actor)
+            (*user.actor)->touch();
+    }
 }
 
 void TileMap::serialize(lua_State* L, Serializer* serializer, ObjectRef* ref)
@@ -215,6 +328,11 @@ int TileMap::script_setTileSet(lua_State* L)
 {
     TileMap* tilemap = TileMap::checkUserdata(L, 1);
     tilemap->setChild(L, 2, tilemap->m_tileset);
+    tilemap->m_geometry.invalidate();
+    tilemap->m_chunks.invalidate();
+
+    // Tile flags may have changed, so collisions predicted against the map are out of date
+    tilemap->touchUsers();
     return 0;
 }
 
@@ -222,6 +340,7 @@ int TileMap::script_setTileMask(lua_State* L)
 {
     TileMap* tilemap = TileMap::checkUserdata(L, 1);
     tilemap->setChild(L, 2, tilemap->m_mask);
+    tilemap->m_chunks.invalidate();
     return 0;
 }
 
@@ -250,6 +369,11 @@ int TileMap::script_setSize(lua_State* L)
 
     tilemap->m_cols = w;
     tilemap->m_rows = h;
+    tilemap->m_geometry.resize(w, h);
+    tilemap->m_chunks.resize(w, h);
+
+    // Bounds follow the size of the map
+    tilemap->touchUsers();
 
     // Return early if w hasn't changed; can simply resize
     if (w == cols)
@@ -261,13 +385,15 @@ int TileMap::script_setSize(lua_State* L)
     // TODO Do we need to preserve the old data? Could just resize and clear
 
     // For resizing purposes, the last row is the lesser of the old and the new
-    const auto i = tilemap->m_map.begin();
+    auto i = tilemap->m_map.begin();
     const int lastRow = std::min(rows, h) - 1;
 
     if (w > cols)
     {
         // Resize first so we can shift the old rows into the new space
+        // NOTE growing may reallocate, so the iterator is taken again
         tilemap->m_map.resize(w * h, 0);
+        i = tilemap->m_map.begin();
 
         // Shift the old rows outward starting from the end
         for (int row = lastRow; row > 0; --row)
@@ -325,6 +451,10 @@ int TileMap::script_setTiles(lua_State* L)
     if (w == 0 || h == 0)
         return 0;
 
+    tilemap->m_geometry.invalidateRows(y, y + h);
+    tilemap->m_chunks.invalidateRect(x, y, w, h);
+    tilemap->touchUsers();
+
     int index = tilemap->toIndex(x, y);
     for (int row = 0; row < h; ++row)
     {
@@ -385,6 +515,10 @@ int TileMap::script_moveTiles(lua_State* L)
     const int old_i = tilemap->toIndex(x, y);
     const int new_i = tilemap->toIndex(x + dx, y + dy);
 
+    tilemap->m_geometry.invalidateRows(y + dy, y + dy + h);
+    tilemap->m_chunks.invalidateRect(x + dx, y + dy, w, h);
+    tilemap->touchUsers();
+
     if (new_i > old_i)
     {
         for (int row = h-1; row >= 0; --row)
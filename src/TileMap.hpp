@@ -1,15 +1,44 @@
 #pragma once
 
 #include "IUserdata.hpp"
+#include "TileGeometry.hpp"
+#include "ResourceHandle.hpp"
 
 #include <string>
 #include <vector>
 #include <algorithm>
 #include <cstdint>
 
+class Actor;
+
+// Change stamps for square chunks of tiles, so renderers can tell which parts of a map to redraw
+// NOTE stamps are taken from a single counter, so they never repeat, even across objects
+class TileChunks
+{
+    std::vector<uint32_t> m_stamps;
+    int m_cols = 0, m_rows = 0; // in chunks
+
+    static uint32_t s_nextStamp;
+
+public:
+    static constexpr const int Size = 32; // tiles along each side of a chunk
+
+    void resize(int cols, int rows);
+    void invalidate();
+    void invalidateRect(int x, int y, int w, int h);
+
+    int getCols() const {return m_cols;}
+    int getRows() const {return m_rows;}
+    uint32_t getStamp(int x, int y) const {return x < m_cols && y < m_rows ? m_stamps[y * m_cols + x] : 0;}
+
+    bool operator==(const TileChunks& other) const {return m_cols == other.m_cols && m_stamps == other.m_stamps;}
+    bool operator!=(const TileChunks& other) const {return !(*this == other);}
+};
+
 class TileSet : public TUserdata<TileSet>
 {
     std::string m_filename;
+    ResourceHandle m_texture; // resolved from m_filename
     std::vector<uint8_t> m_flags;
     int m_cols, m_rows;
 
@@ -19,6 +48,7 @@ public:
     ~TileSet() {}
 
     const std::string& getFilename() const {return m_filename;}
+    const ResourceHandle& getTexture() const {return m_texture;}
     int getCols() const {return m_cols;}
     int getRows() const {return m_rows;}
 
@@ -33,6 +63,7 @@ public:
 
 private:
     friend class TUserdata<TileSet>;
+    friend class RenderQueue;
     void construct(lua_State* L);
     void clone(lua_State* L, TileSet* source);
     //void destroy(lua_State* L) {}
@@ -52,21 +83,29 @@ class TileMask : public TUserdata<TileMask>
 {
     std::vector<uint8_t> m_mask;
     int m_cols, m_rows;
+    TileChunks m_chunks;
 
 public:
     ~TileMask() {}
 
     int getCols() const {return m_cols;}
     int getRows() const {return m_rows;}
+    const TileChunks& getChunks() const {return m_chunks;}
 
     // TODO clamp to border instead of failing?
 
     uint8_t getMask(int i) const {assert(isValidIndex(i)); return m_mask[i];}
     uint8_t getMask(int x, int y) const {assert(isValidIndex(x, y)); return getMask(toIndex(x, y));}
 
+    // NOTE setMask leaves invalidating chunks to the caller, as it is mostly called in loops
     void setMask(int i, uint8_t val) {assert(isValidIndex(i)); m_mask[i] = val;}
     void setMask(int x, int y, uint8_t val) {assert(isValidIndex(x, y)); setMask(toIndex(x, y), val);}
-    void fillMask(uint8_t val) {std::fill(m_mask.begin(), m_mask.end(), val);}
+    void fillMask(uint8_t val) {std::fill(m_mask.begin(), m_mask.end(), val); m_chunks.invalidate();}
+    void invalidateRect(int x, int y, int w, int h) {m_chunks.invalidateRect(x, y, w, h);}
+
+    // Get the mask at the corners of tiles left to right and top to bottom, each averaged over the tiles sharing it
+    // NOTE corners are stored in rows of right - left + 1, for shading smoothly across tiles
+    void getCorners(int left, int top, int right, int bottom, std::vector<uint8_t>& corners) const;
 
     bool isValidIndex(int i) const {return i >= 0 && i < m_mask.size();}
     bool isValidIndex(int x, int y) const {return x >= 0 && y >= 0 && x < m_cols && y < m_rows;}
@@ -74,6 +113,7 @@ public:
 
 private:
     friend class TUserdata<TileMask>;
+    friend class RenderQueue;
     void construct(lua_State* L);
     void clone(lua_State* L, TileMask* source);
     //void destroy(lua_State* L) {}
@@ -106,6 +146,7 @@ private:
 				tileMaskA->setMask(x, y, T(maskA, maskB));
 			}
 		}
+		tileMaskA->m_chunks.invalidate();
 
 		return 0;
 	}
@@ -129,6 +170,17 @@ class TileMap : public TUserdata<TileMap>
     TileMask* m_mask;
     std::vector<int> m_map;
     int m_cols, m_rows;
+    TileGeometry m_geometry; // merged MoveBlocking tiles, invalidated as tiles change
+    TileChunks m_chunks; // invalidated as tiles, the tileset or the mask change
+
+    // Components whose bounds or collisions follow the map, by their Actor and TileMap members
+    // NOTE links are dropped by whichever side is destroyed first, as both may be collected in the same cycle
+    struct User
+    {
+        Actor* const* actor;
+        TileMap** tilemap;
+    };
+    std::vector<User> m_users;
 
     TileMap(): m_tileset(nullptr), m_mask(nullptr) {}
 
@@ -140,6 +192,7 @@ public:
     const TileMask* getTileMask() const {return m_mask;}
     int getCols() const {return m_cols;}
     int getRows() const {return m_rows;}
+    const TileChunks& getChunks() const {return m_chunks;}
 
     int getIndex(int i) const {assert(isValidIndex(i)); return m_map[i];}
     int getIndex(int x, int y) const {assert(isValidIndex(x, y)); return getIndex(toIndex(x, y));}
@@ -151,11 +204,22 @@ public:
     bool isFlagSet(int x, int y, uint8_t flag) const {assert(m_tileset); return m_tileset->isFlagSet(getIndex(x, y), flag);}
     int toIndex(int x, int y) const {return y * m_cols + x;}
 
+    const TileGeometry& getGeometry() {m_geometry.update(*this); return m_geometry;}
+
+    // Keep a component's link in step with its TileMap member, after the member is set or before it's destroyed
+    // NOTE Actors of linked components are touched when the map's size or tiles change
+    static void link(TileMap* previous, Actor* const* actor, TileMap** tilemap);
+    static void unlink(TileMap** tilemap);
+
 private:
+    void removeUser(TileMap** tilemap);
+    void touchUsers();
+
     friend class TUserdata<TileMap>;
+    friend class RenderQueue; // takes copies to render on another thread
     void construct(lua_State* L);
     void clone(lua_State* L, TileMap* source);
-    //void destroy(lua_State* L) {}
+    void destroy(lua_State* L);
     void serialize(lua_State* L, Serializer* serializer, ObjectRef* ref);
 
     static int script_setTileSet(lua_State* L);
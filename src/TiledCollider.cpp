@@ -5,6 +5,7 @@
 
 #include <cmath>
 #include <algorithm>
+#include <limits>
 #include <cassert>
 
 const luaL_Reg TiledCollider::METHODS[];
@@ -38,10 +39,7 @@ bool TiledCollider::testCollision(const Aabb& aabb) const
 {
     assert(m_actor != nullptr);
 
-    if (!m_tilemap->getTileSet())
-        return false;
-
-    if (!isCollidable() || !m_tilemap)
+    if (!isCollidable() || !m_tilemap || !m_tilemap->getTileSet())
         return false;
 
     // Reject early if no overlap
@@ -49,30 +47,10 @@ bool TiledCollider::testCollision(const Aabb& aabb) const
     if (!bounds.isOverlapping(aabb))
         return false;
 
-    // Translate AABB relative to transform
-    const float left = aabb.getLeft() - bounds.getLeft();
-    const float top = aabb.getTop() - bounds.getTop();
-    const float right = aabb.getRight() - bounds.getLeft();
-    const float bottom = aabb.getBottom() - bounds.getTop();
-
-    // Map to tile map coordinates
-    // NOTE using ceil for right/bottom since these are exclusive ranges
-    const int tileLeft = std::max(0, int(floor(left * m_tilemap->getCols() / bounds.getWidth())));
-    const int tileRight = std::min(m_tilemap->getCols(), int(ceil(right * m_tilemap->getCols() / bounds.getWidth())));
-    const int tileTop = std::max(0, int(floor(top * m_tilemap->getRows() / bounds.getHeight())));
-    const int tileBottom = std::min(m_tilemap->getRows(), int(ceil(bottom * m_tilemap->getRows() / bounds.getHeight())));
-
-    // Iterate over range of tiles that overlap
-    for (int y = tileTop; y < tileBottom; ++y)
-    {
-        for (int x = tileLeft; x < tileRight; ++x)
-        {
-            if (m_tilemap->isFlagSet(x, y, TileSet::MoveBlocking))
-                return true;
-        }
-    }
-
-    return false;
+    // Any merged blocking tiles in range are a collision
+    int tileLeft, tileTop, tileRight, tileBottom;
+    getTileRange(bounds, aabb, tileLeft, tileTop, tileRight, tileBottom);
+    return m_tilemap->getGeometry().query(tileLeft, tileTop, tileRight, tileBottom, [](const TileGeometry::Rect& /*rect*/) {return true;});
 }
 
 // NOTE: testing a tilemap against an aabb will be much less effient than vise versa;
@@ -81,11 +59,9 @@ bool TiledCollider::testCollision(float deltaX, float deltaY, const ICollider* o
 {
     assert(m_actor != nullptr);
     assert(other != nullptr);
+    assert(other->m_actor != nullptr);
 
-    if (!m_tilemap->getTileSet())
-        return false;
-
-    if (!isCollidableWith(other) || !m_tilemap)
+    if (!isCollidableWith(other) || !m_tilemap || !m_tilemap->getTileSet())
         return false;
 
     // Reject early if there is no overlap with the map bounds
@@ -94,56 +70,207 @@ bool TiledCollider::testCollision(float deltaX, float deltaY, const ICollider* o
     if (!other->testCollision(bounds))
         return false;
 
-    // TODO might be more efficient to keep subdividing like a BVH
-    // TODO another approach would be to combine adjacent collidable tiles into larger AABBs
-    // NOTE could also add a getAabb to ICollider to use to restrict our range
+    // Restrict the range to the bounds of the other Actor
+    int tileLeft, tileTop, tileRight, tileBottom;
+    getTileRange(bounds, other->m_actor->getAabb(), tileLeft, tileTop, tileRight, tileBottom);
 
-    // Iterate over all tiles
+    // Test each merged block of tiles in range against the collider
     const int rows = m_tilemap->getRows();
     const int cols = m_tilemap->getCols();
-    for (int y = 0; y < rows; ++y)
+    return m_tilemap->getGeometry().query(tileLeft, tileTop, tileRight, tileBottom, [&bounds, rows, cols, other](const TileGeometry::Rect& rect)
     {
-        for (int x = 0; x < cols; ++x)
+        const float left = bounds.getLeft() + (rect.left * bounds.getWidth() / cols);
+        const float right = bounds.getLeft() + (rect.right * bounds.getWidth() / cols);
+        const float top = bounds.getTop() + (rect.top * bounds.getHeight() / rows);
+        const float bottom = bounds.getTop() + (rect.bottom * bounds.getHeight() / rows);
+        return other->testCollision(Aabb(left, top, right, bottom));
+    });
+}
+
+// Map an AABB to the range of tiles it overlaps, clamped to the tile map
+void TiledCollider::getTileRange(const Aabb& bounds, const Aabb& aabb, int& tileLeft, int& tileTop, int& tileRight, int& tileBottom) const
+{
+    // Translate AABB relative to transform
+    const float left = aabb.getLeft() - bounds.getLeft();
+    const float top = aabb.getTop() - bounds.getTop();
+    const float right = aabb.getRight() - bounds.getLeft();
+    const float bottom = aabb.getBottom() - bounds.getTop();
+
+    // Map to tile map coordinates
+    // NOTE using ceil for right/bottom since these are exclusive ranges
+    tileLeft = std::max(0, int(floor(left * m_tilemap->getCols() / bounds.getWidth())));
+    tileRight = std::min(m_tilemap->getCols(), int(ceil(right * m_tilemap->getCols() / bounds.getWidth())));
+    tileTop = std::max(0, int(floor(top * m_tilemap->getRows() / bounds.getHeight())));
+    tileBottom = std::min(m_tilemap->getRows(), int(ceil(bottom * m_tilemap->getRows() / bounds.getHeight())));
+}
+
+// Visit the blocking tiles in the order they are reached by an AABB moving at velX, velY (a DDA over rows and columns),
+// stopping once no later tile could be hit before the earliest collision found so far, or after horizon
+template <class T>
+bool TiledCollider::getEarliestTile(const Aabb& aabb, float velX, float velY, float horizon, T getTileTime, float& start, float& end, float& normX, float& normY) const
+{
+    const Aabb bounds = m_actor->getAabb();
+    const int rows = m_tilemap->getRows();
+    const int cols = m_tilemap->getCols();
+    if (rows <= 0 || cols <= 0 || bounds.getWidth() <= 0.f || bounds.getHeight() <= 0.f)
+        return false;
+
+    // Map to tile map coordinates
+    const float tileWidth = bounds.getWidth() / cols;
+    const float tileHeight = bounds.getHeight() / rows;
+    const float left = (aabb.getLeft() - bounds.getLeft()) / tileWidth;
+    const float right = (aabb.getRight() - bounds.getLeft()) / tileWidth;
+    const float top = (aabb.getTop() - bounds.getTop()) / tileHeight;
+    const float bottom = (aabb.getBottom() - bounds.getTop()) / tileHeight;
+    const float stepX = velX / tileWidth;
+    const float stepY = velY / tileHeight;
+
+    bool found = false;
+    float tempStart, tempEnd, tempNormX, tempNormY;
+    start = std::numeric_limits<float>::max();
+
+    // Test a range of tiles, keeping the earliest collision
+    // NOTE using ceil for right/bottom since these are exclusive ranges; clamping before converting to int
+    auto testTiles = [&](float tileLeft, float tileTop, float tileRight, float tileBottom)
+    {
+        const int x1 = int(std::max(0.f, std::floor(tileLeft)));
+        const int x2 = int(std::min(float(cols), std::ceil(tileRight)));
+        const int y1 = int(std::max(0.f, std::floor(tileTop)));
+        const int y2 = int(std::min(float(rows), std::ceil(tileBottom)));
+        for (int y = y1; y < y2; ++y)
+        {
+            for (int x = x1; x < x2; ++x)
+            {
+                if (!m_tilemap->isFlagSet(x, y, TileSet::MoveBlocking))
+                    continue;
+
+                // If collidable, compute AABB for tile
+                const Aabb tileAabb(bounds.getLeft() + (x * bounds.getWidth() / cols), bounds.getTop() + (y * bounds.getHeight() / rows),
+                    bounds.getLeft() + ((x + 1) * bounds.getWidth() / cols), bounds.getTop() + ((y + 1) * bounds.getHeight() / rows));
+
+                // NOTE only considering inward movement, as in Canvas::getEarliestCollision
+                if (getTileTime(tileAabb, tempStart, tempEnd, tempNormX, tempNormY)
+                    && tempEnd > 0.f && (tempStart >= 0.f || tempEnd > fabs(tempStart)) && tempStart < start)
+                {
+                    start = tempStart;
+                    end = tempEnd;
+                    normX = tempNormX;
+                    normY = tempNormY;
+                    found = true;
+                }
+            }
+        }
+    };
+
+    // Tiles that are already overlapping can only have been hit in the past
+    testTiles(left, top, right, bottom);
+    if (found)
+        return true;
+
+    // Find the first column and row boundaries crossed by the leading edges
+    // NOTE skipping ahead to the edge of the map when starting outside of it
+    int boundaryX = 0, boundaryY = 0;
+    if (stepX > 0.f)
+        boundaryX = int(std::min(float(cols), std::max(0.f, std::ceil(right))));
+    else if (stepX < 0.f)
+        boundaryX = int(std::max(0.f, std::min(float(cols), std::floor(left))));
+
+    if (stepY > 0.f)
+        boundaryY = int(std::min(float(rows), std::max(0.f, std::ceil(bottom))));
+    else if (stepY < 0.f)
+        boundaryY = int(std::max(0.f, std::min(float(rows), std::floor(top))));
+
+    const int dirX = stepX > 0.f ? 1 : -1;
+    const int dirY = stepY > 0.f ? 1 : -1;
+    const float edgeX = stepX > 0.f ? right : left;
+    const float edgeY = stepY > 0.f ? bottom : top;
+
+    while (true)
+    {
+        // Index of the column or row entered at each boundary
+        const int col = dirX > 0 ? boundaryX : boundaryX - 1;
+        const int row = dirY > 0 ? boundaryY : boundaryY - 1;
+        const bool hasX = stepX != 0.f && col >= 0 && col < cols;
+        const bool hasY = stepY != 0.f && row >= 0 && row < rows;
+        if (!hasX && !hasY)
+            break;
+
+        const float timeX = hasX ? (boundaryX - edgeX) / stepX : std::numeric_limits<float>::max();
+        const float timeY = hasY ? (boundaryY - edgeY) / stepY : std::numeric_limits<float>::max();
+        const float time = std::min(timeX, timeY);
+
+        // No remaining tile can be reached before the earliest collision, or before the horizon
+        // NOTE this keeps the walk proportional to the distance travelled, rather than the size of the map
+        if ((found && time > start) || time > horizon)
+            break;
+
+        // Test the strip of tiles just entered
+        if (timeX <= timeY)
+        {
+            testTiles(float(col), top + stepY * time, float(col + 1), bottom + stepY * time);
+            boundaryX += dirX;
+        }
+        else
         {
-            if (!m_tilemap->isFlagSet(x, y, TileSet::MoveBlocking))
-                continue;
-
-            // If collidable, compute AABB for tile
-            const float left = bounds.getLeft() + (x * bounds.getWidth() / cols);
-            const float right = bounds.getLeft() + ((x + 1) * bounds.getWidth() / cols);
-            const float top = bounds.getTop() + (y * bounds.getHeight() / rows);
-            const float bottom = bounds.getTop() + ((y + 1) * bounds.getHeight() / rows);
-            const Aabb tileAabb(left, top, right, bottom);
-
-            // Test the tile AABB against the collider
-            if (other->testCollision(tileAabb))
-                return true;
+            testTiles(left + stepX * time, float(row), right + stepX * time, float(row + 1));
+            boundaryY += dirY;
         }
     }
 
-    return false;
+    return found;
 }
 
-bool TiledCollider::getCollisionTime(const Aabb& /*aabb*/, float /*velX*/, float /*velY*/, float& /*start*/, float& /*end*/, float& /*normX*/, float& /*normY*/) const
+// NOTE here we are taking the velocity of the other object
+bool TiledCollider::getCollisionTime(const Aabb& aabb, float velX, float velY, float horizon, float& start, float& end, float& normX, float& normY) const
 {
-    // TODO need to implement
-    return false;
+    assert(m_actor != nullptr);
+
+    if (!isCollidable() || !m_tilemap || !m_tilemap->getTileSet())
+        return false;
+
+    return getEarliestTile(aabb, velX, velY, horizon, [&aabb, velX, velY](const Aabb& tile, float& start, float& end, float& normX, float& normY)
+    {
+        Aabb::Edge edge;
+        const bool result = tile.getCollisionTime(aabb, velX, velY, start, end, edge);
+        Aabb::getNormal(edge, normX, normY);
+        return result;
+    }, start, end, normX, normY);
 }
 
-bool TiledCollider::getCollisionTime(float /*velX*/, float /*velY*/, const ICollider* /*other*/, float& /*start*/, float& /*end*/, float& /*normX*/, float& /*normY*/) const
+// NOTE here we are taking the velocity of THIS object
+bool TiledCollider::getCollisionTime(float velX, float velY, const ICollider* other, float horizon, float& start, float& end, float& normX, float& normY) const
 {
-    // TODO need to implement
-    return false;
+    assert(m_actor != nullptr);
+    assert(other != nullptr);
+
+    if (!isCollidableWith(other) || !m_tilemap || !m_tilemap->getTileSet())
+        return false;
+
+    // Walk our tiles as if the other collider's bounds were moving the opposite way,
+    // but let the other collider work out the exact collision with each tile
+    // NOTE normals are therefore from the perspective of the other collider, as with AabbCollider
+    const Aabb bounds = other->m_actor->getAabb();
+    return getEarliestTile(bounds, -velX, -velY, horizon, [other, velX, velY, horizon](const Aabb& tile, float& start, float& end, float& normX, float& normY)
+    {
+        return other->getCollisionTime(tile, velX, velY, horizon, start, end, normX, normY);
+    }, start, end, normX, normY);
 }
 
 void TiledCollider::construct(lua_State* L)
 {
     getChildOpt(L, 2, "tilemap", m_tilemap);
+    TileMap::link(nullptr, &m_actor, &m_tilemap);
 }
 
 void TiledCollider::clone(lua_State* L, TiledCollider* source)
 {
     copyChild(L, m_tilemap, source->m_tilemap);
+    TileMap::link(nullptr, &m_actor, &m_tilemap);
+}
+
+void TiledCollider::destroy(lua_State* /*L*/)
+{
+    TileMap::unlink(&m_tilemap);
 }
 
 void TiledCollider::serialize(lua_State* L, Serializer* serializer, ObjectRef* ref)
@@ -160,6 +287,12 @@ int TiledCollider::script_getTileMap(lua_State* L)
 int TiledCollider::script_setTileMap(lua_State* L)
 {
     TiledCollider* collider = TiledCollider::checkUserdata(L, 1);
+    TileMap* const previous = collider->m_tilemap;
     collider->setChild(L, 2, collider->m_tilemap);
+    TileMap::link(previous, &collider->m_actor, &collider->m_tilemap);
+
+    // Collisions predicted against the old map are out of date
+    if (collider->m_actor)
+        collider->m_actor->touch();
     return 0;
 }
@@ -21,14 +21,19 @@ public:
     // this would probably only be reasonable when testing a tilemap against a tilemap
     bool testCollision(float deltaX, float deltaY, const ICollider* other) const override;
 
-    bool getCollisionTime(const Aabb& aabb, float velX, float velY, float& start, float& end, float& normX, float& normY) const override;
-    bool getCollisionTime(float velX, float velY, const ICollider* other, float& start, float& end, float& normX, float& normY) const override;
+    bool getCollisionTime(const Aabb& aabb, float velX, float velY, float horizon, float& start, float& end, float& normX, float& normY) const override;
+    bool getCollisionTime(float velX, float velY, const ICollider* other, float horizon, float& start, float& end, float& normX, float& normY) const override;
 
 private:
+    void getTileRange(const Aabb& bounds, const Aabb& aabb, int& tileLeft, int& tileTop, int& tileRight, int& tileBottom) const;
+
+    template <class T>
+    bool getEarliestTile(const Aabb& aabb, float velX, float velY, float horizon, T getTileTime, float& start, float& end, float& normX, float& normY) const;
+
     friend class TUserdata<TiledCollider, ICollider>;
     void construct(lua_State* L);
     void clone(lua_State* L, TiledCollider* source);
-    //void destroy(lua_State* L) {}
+    void destroy(lua_State* L);
     void serialize(lua_State* L, Serializer* serializer, ObjectRef* ref);
 
     static int script_getTileMap(lua_State* L);
@@ -53,11 +53,18 @@ void TiledGraphics::getSize(float& w, float& h) const
 void TiledGraphics::construct(lua_State* L)
 {
     getChildOpt(L, 2, "tilemap", m_tilemap);
+    TileMap::link(nullptr, &m_actor, &m_tilemap);
 }
 
 void TiledGraphics::clone(lua_State* L, TiledGraphics* source)
 {
     copyChild(L, m_tilemap, source->m_tilemap);
+    TileMap::link(nullptr, &m_actor, &m_tilemap);
+}
+
+void TiledGraphics::destroy(lua_State* /*L*/)
+{
+    TileMap::unlink(&m_tilemap);
 }
 
 void TiledGraphics::serialize(lua_State* L, Serializer* serializer, ObjectRef* ref)
@@ -74,6 +81,12 @@ int TiledGraphics::script_getTileMap(lua_State* L)
 int TiledGraphics::script_setTileMap(lua_State* L)
 {
     TiledGraphics* graphics = TiledGraphics::checkUserdata(L, 1);
+    TileMap* const previous = graphics->m_tilemap;
     graphics->setChild(L, 2, graphics->m_tilemap);
+    TileMap::link(previous, &graphics->m_actor, &graphics->m_tilemap);
+
+    // Bounds follow the size of the TileMap
+    if (graphics->m_actor)
+        graphics->m_actor->touch();
     return 0;
 }
@@ -0,0 +1,89 @@
+#include "Watchdog.hpp"
+
+#include <chrono>
+#include <cassert>
+
+Watchdog::Watchdog()
+{
+    m_thread = std::thread(&Watchdog::work, this);
+}
+
+Watchdog::~Watchdog()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wake.notify_one();
+
+    m_thread.join();
+}
+
+void Watchdog::arm()
+{
+    if (m_depth++ > 0)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_active = true;
+    }
+    m_wake.notify_one();
+}
+
+void Watchdog::disarm()
+{
+    assert(m_depth > 0);
+    if (--m_depth > 0)
+        return;
+
+    // NOTE the thread notices on its next tick, so there is no need to wake it
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_active = false;
+}
+
+void Watchdog::begin(int millis)
+{
+    m_call = ++m_calls;
+    m_limit = millis;
+
+    // Publish the limit along with the call
+    m_runningLimit.store(millis, std::memory_order_relaxed);
+    m_running.store(m_call, std::memory_order_release);
+}
+
+void Watchdog::end()
+{
+    m_call = 0;
+    m_running.store(0, std::memory_order_relaxed);
+}
+
+void Watchdog::work()
+{
+    using namespace std::chrono;
+
+    // The call last seen running, and when it was first seen
+    // NOTE a call is seen up to a tick after it begins, so it is never reported before its limit
+    uint64_t seen = 0;
+    steady_clock::time_point seenTime;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_wake.wait(lock, [this] {return m_quit || m_active;});
+        if (m_quit)
+            return;
+
+        m_wake.wait_for(lock, milliseconds(TickMillis), [this] {return m_quit;});
+
+        const uint64_t call = m_running.load(std::memory_order_acquire);
+        const auto now = steady_clock::now();
+        if (call != seen)
+        {
+            seen = call;
+            seenTime = now;
+        }
+        else if (call != 0 && now - seenTime >= milliseconds(m_runningLimit.load(std::memory_order_relaxed)))
+            m_expired.store(call, std::memory_order_relaxed);
+    }
+}
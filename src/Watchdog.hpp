@@ -0,0 +1,53 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+// Times script calls on a thread of its own, so checking for a call that runs too long is a single atomic read
+// NOTE calls are numbered rather than timed; while armed, the thread polls for the same call still running past its limit
+class Watchdog
+{
+    static constexpr const int TickMillis = 2; // how often calls are polled while armed, and so how late a limit may be reported
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_active = false; // guarded by m_mutex
+    bool m_quit = false; // guarded by m_mutex
+
+    // Only used on the thread making calls
+    int m_depth = 0;
+    uint64_t m_calls = 0;
+    uint64_t m_call = 0; // the call in progress, or 0
+    int m_limit = 0;
+
+    // Shared with the watchdog thread
+    std::atomic<uint64_t> m_running{0};
+    std::atomic<int> m_runningLimit{0};
+    std::atomic<uint64_t> m_expired{0}; // the last call found past its limit
+
+public:
+    Watchdog();
+    ~Watchdog();
+
+    Watchdog(const Watchdog&) = delete;
+    Watchdog& operator=(const Watchdog&) = delete;
+
+    // Start and stop polling, once per frame rather than per call
+    // NOTE nested arms are counted, so only the outermost pair wakes or idles the thread
+    void arm();
+    void disarm();
+
+    // Mark the start and end of a call limited to millis
+    void begin(int millis);
+    void end();
+
+    bool isExpired() const {return m_expired.load(std::memory_order_relaxed) == m_call && m_call != 0;}
+    int getLimit() const {return m_limit;}
+
+private:
+    void work();
+};
@@ -0,0 +1,87 @@
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(int threads): m_next(0)
+{
+    for (int i = 1; i < threads; ++i)
+        m_threads.emplace_back(&WorkerPool::work, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_started.notify_all();
+
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+void WorkerPool::run(int count, const std::function<void(int)>& task)
+{
+    if (count <= 0)
+        return;
+
+    // Not worth waking anyone for a single task
+    if (m_threads.empty() || count == 1)
+    {
+        for (int i = 0; i < count; ++i)
+            task(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = task;
+        m_count = count;
+        m_next = 0;
+        m_busy = int(m_threads.size());
+        ++m_batch;
+    }
+    m_started.notify_all();
+
+    runTasks();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_finished.wait(lock, [this] {return m_busy == 0;});
+    m_task = nullptr;
+}
+
+int WorkerPool::getThreadCount(int requested)
+{
+    if (requested > 0)
+        return requested;
+
+    // NOTE hardware_concurrency may be unknown, reported as 0
+    return std::max(1, int(std::thread::hardware_concurrency()));
+}
+
+void WorkerPool::work()
+{
+    unsigned batch = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_started.wait(lock, [this, batch] {return m_quit || m_batch != batch;});
+            if (m_quit)
+                return;
+            batch = m_batch;
+        }
+
+        runTasks();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_busy == 0)
+            m_finished.notify_one();
+    }
+}
+
+void WorkerPool::runTasks()
+{
+    for (int i = m_next++; i < m_count; i = m_next++)
+        m_task(i);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+// Persistent threads that take tasks from a shared batch, with the calling thread helping out
+// NOTE tasks may finish in any order, so callers needing determinism should write results by task index
+class WorkerPool
+{
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_started;
+    std::condition_variable m_finished;
+    std::function<void(int)> m_task;
+    std::atomic<int> m_next;
+    int m_count = 0; // tasks in the current batch
+    int m_busy = 0; // workers yet to finish the current batch
+    unsigned m_batch = 0; // incremented for each batch, so workers can tell a new one has started
+    bool m_quit = false;
+
+public:
+    explicit WorkerPool(int threads); // NOTE includes the calling thread
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    int getThreadCount() const {return int(m_threads.size()) + 1;}
+
+    // Call task for each index up to count, returning once all calls are done
+    void run(int count, const std::function<void(int)>& task);
+
+    // Resolve a requested thread count; 0 for one per hardware thread
+    static int getThreadCount(int requested);
+
+private:
+    void work();
+    void runTasks();
+};
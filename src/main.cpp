@@ -31,7 +31,15 @@ struct Platform {const char* const key; RunFunc func;};
 #define PLATFORM_GLFW
 #endif
 
-static Platform platforms[] = {PLATFORM_SDL PLATFORM_GLFW {nullptr, nullptr}};
+#ifdef PLATFORM_SOFT
+#undef PLATFORM_SOFT
+#include "SoftInstance.hpp"
+#define PLATFORM_SOFT {"-soft", SoftInstance::run},
+#else
+#define PLATFORM_SOFT
+#endif
+
+static Platform platforms[] = {PLATFORM_SDL PLATFORM_GLFW PLATFORM_SOFT {nullptr, nullptr}};
 
 bool findPlatform(const char* key, RunFunc& func)
 {
@@ -0,0 +1,107 @@
+-- Resizes and edits TileMaps while Actors use them, checking queries and collisions see the new tiles
+-- NOTE errors fail the frame test, as they are reported on stderr
+
+local game = Canvas{camera = Camera2D{size = {16, 12}, fixed = true}}
+addCanvas(game)
+
+local map = TileMap
+{
+    tileset = TileSet
+    {
+        filename = "tiles.tga",
+        size = {2, 3},
+        data = {0, 0, 3, 3, 2, 0}
+    },
+    size = {4, 4}
+}
+map:setTiles(0, 0, 4, 4, 3)
+
+local wall = Actor
+{
+    graphics = TiledGraphics{tilemap = map},
+    collider = TiledCollider{tilemap = map},
+    transform = {position = {0, 0}}
+}
+game:addActor(wall)
+
+-- Moves left into the area the map grows into
+local box = Actor
+{
+    graphics = SpriteGraphics{sprite = "square.tga"},
+    collider = AabbCollider{},
+    physics = {velocity = {-4, 0}},
+    transform = {position = {10, 1}}
+}
+game:addActor(box)
+
+-- A gate of two tiles, opened by the first box to hit it, just before the second box reaches it in the same frame
+local gateMap = TileMap
+{
+    tileset = TileSet
+    {
+        filename = "tiles.tga",
+        size = {2, 3},
+        data = {0, 0, 3, 3, 2, 0}
+    },
+    size = {1, 2}
+}
+gateMap:setTiles(0, 0, 1, 2, 3)
+
+local gate = Actor
+{
+    graphics = TiledGraphics{tilemap = gateMap},
+    collider = TiledCollider{tilemap = gateMap},
+    transform = {position = {4, 6}}
+}
+game:addActor(gate)
+
+local opener = Actor
+{
+    graphics = SpriteGraphics{sprite = "square.tga"},
+    collider = AabbCollider{},
+    physics = {velocity = {-4, 0}},
+    transform = {position = {6, 6}},
+    members = {onCollide = function(self, other) if other == gate then gateMap:setTiles(0, 0, 1, 2, 0) end end}
+}
+game:addActor(opener)
+
+local follower = Actor
+{
+    graphics = SpriteGraphics{sprite = "square.tga"},
+    collider = AabbCollider{},
+    physics = {velocity = {-4, 0}},
+    transform = {position = {6.02, 7}},
+    members = {onCollide = function(self, other) self.hit = other end}
+}
+game:addActor(follower)
+
+local function check(condition, message)
+    if not condition then
+        error(message, 2)
+    end
+end
+
+local frame = 0
+local driver = Actor{}
+function driver:onUpdate(delta)
+    frame = frame + 1
+    if frame == 2 then
+        check(#game:queryPoint(6.5, 1.5) == 0, "query hit outside the map")
+        map:setSize(8, 4)
+        map:setTiles(4, 0, 4, 4, 3)
+    elseif frame == 3 then
+        check(#game:queryPoint(6.5, 1.5) == 1, "query missed the grown map")
+        check(game:raycast(12, 3.5, 0, 3.5) == wall, "raycast missed the grown map")
+        map:setSize(2, 4)
+    elseif frame == 4 then
+        check(#game:queryPoint(3.5, 1.5) == 0, "query hit the shrunk map")
+        map:setSize(8, 4)
+        map:setTiles(2, 0, 6, 4, 3)
+    elseif frame == 60 then
+        local x, y = box:getPosition()
+        check(x >= 8, "box passed into the grown map")
+        check(follower.hit ~= gate, "follower hit the opened gate")
+        check(follower:getPosition() < 4, "follower stopped at the opened gate")
+    end
+end
+game:addActor(driver)